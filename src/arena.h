@@ -0,0 +1,153 @@
+/*
+ *  Scratch memory of a node, handed out by bumping a pointer and
+ *  taken back all at once at the end of every event.
+ *  Copyright (C) 2021 Sourabh J Choure
+ *
+ *  I promise that the work presented below is of my own.
+ *
+ *  To make it FOSS Compliant, this software is free to use.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+// STL
+#include <algorithm>
+#include <vector>
+// SL
+#include <cstddef>
+
+using namespace std;
+
+// Bytes of the first block, later ones double
+#define ARENA_BLOCK 4096
+
+// Position in the arena to go back to
+struct ArenaMark
+{
+    size_t block;
+    size_t offset;
+};
+
+class Arena
+{
+public:
+    Arena() : block(0), offset(0){};
+    ~Arena();
+
+    // Room for n objects of a plain type, left uninitialized
+    template <class T>
+    T *take(size_t n);
+
+    // Room for n objects, all set to value
+    template <class T>
+    T *take(size_t n, const T &value)
+    {
+        T *p = take<T>(n);
+        fill_n(p, n, value);
+        return p;
+    };
+
+    // Where the arena is now, and going back there
+    ArenaMark mark() const { return ArenaMark{block, offset}; };
+    void rewind(const ArenaMark &m)
+    {
+        block = m.block;
+        offset = m.offset;
+    };
+
+    // Take everything back, in a single block big enough for the next event
+    void reset();
+
+    // Bytes held by the arena
+    size_t capacity() const;
+
+private:
+    vector<char *> blocks;
+    vector<size_t> sizes;
+
+    // Block in use and the first free byte in it
+    size_t block;
+    size_t offset;
+};
+
+// Gives back whatever was taken in a scope
+class ArenaScope
+{
+public:
+    ArenaScope(Arena &arena) : arena(arena), start(arena.mark()){};
+    ~ArenaScope() { arena.rewind(start); };
+
+private:
+    Arena &arena;
+    ArenaMark start;
+};
+
+inline Arena::~Arena()
+{
+    for (size_t i = 0; i < blocks.size(); i++)
+        delete[] blocks[i];
+}
+
+template <class T>
+inline T *Arena::take(size_t n)
+{
+    size_t bytes = n * sizeof(T);
+
+    // Fits in the block in use
+    if (!blocks.empty())
+    {
+        size_t start = (offset + alignof(T) - 1) & ~(alignof(T) - 1);
+        if (start + bytes <= sizes[block])
+        {
+            offset = start + bytes;
+            return (T *)(blocks[block] + start);
+        }
+    }
+
+    // Fits in a block kept from before
+    while (block + 1 < blocks.size())
+    {
+        block++;
+        if (bytes <= sizes[block])
+        {
+            offset = bytes;
+            return (T *)blocks[block];
+        }
+    }
+
+    // Only a new block fits it, which lives until the next reset
+    size_t size = max(bytes, blocks.empty() ? size_t(ARENA_BLOCK) : sizes.back() * 2);
+    blocks.push_back(new char[size]);
+    sizes.push_back(size);
+    block = blocks.size() - 1;
+    offset = bytes;
+    return (T *)blocks[block];
+}
+
+inline void Arena::reset()
+{
+    block = 0;
+    offset = 0;
+
+    if (blocks.size() < 2)
+        return;
+
+    // The next event gets all the room of this one without growing
+    size_t total = capacity();
+    for (size_t i = 0; i < blocks.size(); i++)
+        delete[] blocks[i];
+
+    blocks.assign(1, new char[total]);
+    sizes.assign(1, total);
+}
+
+inline size_t Arena::capacity() const
+{
+    size_t total = 0;
+    for (size_t i = 0; i < sizes.size(); i++)
+        total += sizes[i];
+    return total;
+}
+
+#endif
@@ -0,0 +1,332 @@
+/*
+ *  Benchmarks the nodes and the controller on generated topologies
+ *  in virtual time, and prints the results as JSON lines.
+ *  Copyright (C) 2021 Sourabh J Choure
+ *
+ *  I promise that the work presented below is of my own.
+ *
+ *  To make it FOSS Compliant, this software is free to use.
+ */
+
+// STL
+#include <algorithm>
+#include <map>
+// Unix
+#include <getopt.h>
+#include <sys/resource.h>
+// Simulation
+#include "simulation.h"
+#include "topology.h"
+
+using namespace std;
+
+// Default size and length of a run
+#define BENCH_NODES 100
+#define BENCH_DURATION 120
+
+// Simulation that measures convergence, overhead and delivery of a run
+class Bench : public Simulation
+{
+public:
+    Bench(const NodeOptions &options, const Links &links, const vector<int> &flows, size_t duration);
+
+    // Nodes that stopped with every node that reaches them in their intree
+    size_t complete = 0;
+
+    // Virtual time of the last intree change
+    uint64_t lastChange = 0;
+
+    // Totals over all the nodes
+    size_t controlMessages = 0;
+    size_t controlBytes = 0;
+    size_t dataSent = 0;
+    size_t dataForwarded = 0;
+    size_t dataDelivered = 0;
+
+    // Virtual time from sending to delivery
+    uint64_t latencySum = 0;
+    uint64_t latencyMax = 0;
+    size_t latencyCount = 0;
+
+    // Messages the controller read from the nodes
+    size_t forwarded() { return controller ? controller->stats->messagesRead : 0; };
+
+private:
+    // Number of other nodes with a path to every node in the topology
+    vector<size_t> reachable;
+
+    // Intree changes of every node when it was last looked at
+    vector<size_t> changesSoFar;
+
+    void nodeHandled(size_t);
+    void nodeStopping(size_t);
+};
+
+Bench::Bench(const NodeOptions &options, const Links &links, const vector<int> &flows, size_t duration) : Simulation(options)
+{
+    size_t numNodes = options.numNodes;
+    verbose = false;
+    controllerDuration = duration;
+
+    // Every node runs for the whole benchmark
+    for (size_t i = 0; i < numNodes; i++)
+    {
+        NodeSpec spec = {i, duration, -1, ""};
+        specs.push_back(spec);
+    }
+
+    // A source sends as often as the data message of the command line, and as much,
+    // but every packet carries its sequence number and send time, so a lost one does not throw off the latency
+    for (size_t i = 0; i < numNodes; i++)
+    {
+        if (flows[i] == -1)
+            continue;
+
+        FlowSpec flow;
+        flow.src = i;
+        flow.dest = flows[i];
+        flow.rate = 1.0 / DATA_PERIOD;
+        flow.sizeKind = FIXED_SIZE;
+        flow.sizeMin = flow.sizeMax = ("bench message from " + to_string(i)).length();
+        flow.start = 0;
+        flow.stop = duration * TRAFFIC_SECOND;
+        this->options.flows.push_back(flow);
+    }
+
+    changesSoFar.assign(numNodes, 0);
+
+    // Walk the links backwards from every node
+    vector<vector<size_t>> incoming(numNodes);
+    for (Links::const_iterator link = links.begin(); link != links.end(); link++)
+        incoming[link->second].push_back(link->first);
+
+    reachable.assign(numNodes, 0);
+    vector<size_t> seen(numNodes, numNodes);
+    vector<size_t> queue;
+    for (size_t root = 0; root < numNodes; root++)
+    {
+        queue.assign(1, root);
+        seen[root] = root;
+        for (size_t k = 0; k < queue.size(); k++)
+        {
+            for (size_t j = 0; j < incoming[queue[k]].size(); j++)
+            {
+                size_t w = incoming[queue[k]][j];
+                if (seen[w] != root)
+                {
+                    seen[w] = root;
+                    queue.push_back(w);
+                }
+            }
+        }
+        reachable[root] = queue.size() - 1;
+    }
+}
+
+void Bench::nodeHandled(size_t i)
+{
+    const NodeStats &stats = nodes[i]->stats;
+
+    if (stats.intreeChanges != changesSoFar[i])
+    {
+        changesSoFar[i] = stats.intreeChanges;
+        lastChange = time();
+    }
+}
+
+void Bench::nodeStopping(size_t i)
+{
+    Node &node = *nodes[i];
+
+    if (node.intreeSize() == reachable[i])
+        complete++;
+
+    controlMessages += node.stats.helloSent + node.stats.intreeSent + node.stats.snapshotSent + node.stats.resyncSent;
+    controlBytes += node.stats.controlBytes;
+    dataSent += node.stats.dataSent;
+    dataForwarded += node.stats.dataForwarded;
+    dataDelivered += node.stats.dataReceived;
+
+    // Latency of the packets that arrived, from the send time they carry
+    for (map<size_t, FlowReceived>::const_iterator it = node.flowsReceived().begin(); it != node.flowsReceived().end(); ++it)
+    {
+        latencySum += it->second.latencySum;
+        latencyMax = max(latencyMax, it->second.latencyMax);
+        latencyCount += it->second.packets;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    // Check for the optional flags
+    NodeOptions options;
+    options.numNodes = BENCH_NODES;
+    size_t duration = BENCH_DURATION;
+    long numFlows = -1;
+    unsigned seed = 1;
+    vector<TopologyKind> kinds;
+    LinkModel link;
+    static struct option longOptions[] = {
+        {"nodes", required_argument, NULL, 'n'},
+        {"topology", required_argument, NULL, 't'},
+        {"duration", required_argument, NULL, 'd'},
+        {"flows", required_argument, NULL, 'f'},
+        {"seed", required_argument, NULL, 'r'},
+        {"spt", required_argument, NULL, 's'},
+        {"intree", required_argument, NULL, 'i'},
+        {"wire", required_argument, NULL, 'w'},
+        {"multipath", required_argument, NULL, 'M'},
+        {"link", required_argument, NULL, 'L'},
+        {NULL, 0, NULL, 0}};
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "+n:t:d:f:r:s:i:w:M:L:", longOptions, NULL)) != -1)
+    {
+        bool valid = true;
+        TopologyKind kind;
+        switch (opt)
+        {
+        case 'n':
+            options.numNodes = strtol(optarg, NULL, 10);
+            valid = (long)options.numNodes > 1;
+            break;
+        case 't':
+            valid = parseTopology(optarg, kind);
+            kinds.push_back(kind);
+            break;
+        case 'd':
+            duration = strtol(optarg, NULL, 10);
+            valid = (long)duration > 0;
+            break;
+        case 'f':
+            numFlows = strtol(optarg, NULL, 10);
+            valid = numFlows >= 0;
+            break;
+        case 'r':
+            seed = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            if (strcmp(optarg, "full") == 0)
+                options.spt = FULL_SPT;
+            else if (strcmp(optarg, "incremental") == 0)
+                options.spt = INCREMENTAL_SPT;
+            else if (strcmp(optarg, "weighted") == 0)
+                options.spt = WEIGHTED_SPT;
+            else
+                valid = false;
+            break;
+        case 'i':
+            if (strcmp(optarg, "full") == 0)
+                options.intree = FULL_INTREE;
+            else if (strcmp(optarg, "delta") == 0)
+                options.intree = DELTA_INTREE;
+            else
+                valid = false;
+            break;
+        case 'w':
+            valid = parseWire(optarg, options.wire);
+            break;
+        case 'M':
+            options.multipath = strtol(optarg, NULL, 10);
+            valid = (long)options.multipath > 0;
+            break;
+        case 'L':
+            valid = parseLinkModel(optarg, link);
+            break;
+        default:
+            valid = false;
+        }
+
+        if (!valid)
+        {
+            cout << "Usage: bench [--nodes N] [--topology ring|grid|random|scalefree|unidirectional]... [--duration D] [--flows F] [--seed S] [--spt full|incremental|weighted] [--intree full|delta] [--wire text|binary] [--multipath K] [--link delay=MS,bw=KBPS,queue=N,loss=P]" << endl;
+            return -1;
+        }
+    }
+
+    //Check number of arguments
+    if (optind != argc)
+    {
+        cout << "too many arguments passed" << endl;
+        return -1;
+    }
+
+    // Every topology unless some were picked
+    if (kinds.empty())
+        for (int k = 0; k < NUM_TOPOLOGIES; k++)
+            kinds.push_back(TopologyKind(k));
+
+    size_t numNodes = options.numNodes;
+    if (numFlows < 0)
+        numFlows = max(numNodes / 10, size_t(1));
+    numFlows = min(size_t(numFlows), numNodes);
+
+    // The received files stay open for every node at once
+    struct rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0)
+    {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+
+    for (size_t t = 0; t < kinds.size(); t++)
+    {
+        // The controller reads the generated topology from the working directory
+        Links links = makeTopology(kinds[t], numNodes, seed);
+        if (!writeTopology(links, "topology"))
+        {
+            cout << "Cannot write the topology file" << endl;
+            return -1;
+        }
+
+        // Pick distinct sources, each sending to some other node
+        mt19937 generator(seed);
+        vector<size_t> order(numNodes);
+        for (size_t i = 0; i < numNodes; i++)
+            order[i] = i;
+        shuffle(order.begin(), order.end(), generator);
+
+        vector<int> flows(numNodes, -1);
+        for (long k = 0; k < numFlows; k++)
+            flows[order[k]] = (order[k] + 1 + generator() % (numNodes - 1)) % numNodes;
+
+        // Start the received files over
+        for (size_t i = 0; i < numNodes; i++)
+            unlink((to_string(i) + "_received").c_str());
+
+        Bench bench(options, links, flows, duration);
+        bench.link = link;
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        bench.run();
+        double wall = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        // One JSON object per run
+        cout << "{\"topology\":\"" << topologyNames[kinds[t]] << "\""
+             << ",\"nodes\":" << numNodes
+             << ",\"links\":" << links.size()
+             << ",\"flows\":" << numFlows
+             << ",\"seed\":" << seed
+             << ",\"duration_s\":" << duration
+             << ",\"spt\":\"" << sptName(options.spt) << "\""
+             << ",\"intree\":\"" << (options.intree == FULL_INTREE ? "full" : "delta") << "\""
+             << ",\"multipath\":" << options.multipath
+             << ",\"wire\":\"" << (options.wire == TEXT_WIRE ? "text" : "binary") << "\""
+             << ",\"converged\":" << (bench.complete == numNodes ? "true" : "false")
+             << ",\"complete_intrees\":" << bench.complete
+             << ",\"convergence_s\":" << double(bench.lastChange) / SECOND
+             << ",\"control_messages_per_node\":" << double(bench.controlMessages) / numNodes
+             << ",\"control_bytes_per_node\":" << double(bench.controlBytes) / numNodes
+             << ",\"data_sent\":" << bench.dataSent
+             << ",\"data_forwarded\":" << bench.dataForwarded
+             << ",\"data_delivered\":" << bench.dataDelivered
+             << ",\"latency_avg_s\":" << (bench.latencyCount ? double(bench.latencySum) / bench.latencyCount / SECOND : 0)
+             << ",\"latency_max_s\":" << double(bench.latencyMax) / SECOND
+             << ",\"controller_messages\":" << bench.forwarded()
+             << ",\"controller_messages_per_s\":" << (bench.controllerTime > 0 ? bench.forwarded() / bench.controllerTime : 0)
+             << ",\"wall_s\":" << wall
+             << "}" << endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,1026 @@
+/*
+ *  Channels between the nodes and the controller. A channel is either
+ *  a plain file, a log of fixed size segment files, a lock-free ring
+ *  buffer in POSIX shared memory, or a queue inside the process when
+ *  everything runs in one simulation.
+ *  Copyright (C) 2021 Sourabh J Choure
+ *
+ *  I promise that the work presented below is of my own.
+ *
+ *  To make it FOSS Compliant, this software is free to use.
+ */
+
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+// STL
+#include <atomic>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+// SL
+#include <cerrno>
+#include <cstring>
+#include <stdint.h>
+// Unix
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <sys/stat.h>
+// Framing
+#include "frame.h"
+// Drop counters
+#include "stats.h"
+
+using namespace std;
+
+// Bytes of message data in every shared memory ring
+#define RING_BYTES (1 << 20)
+
+// Bytes of messages held back for a full ring or a segment that took no more before any more are dropped
+#define UNSENT_BYTES (4 * RING_BYTES)
+
+// Bytes pulled from a segment at a time
+#define READ_CHUNK 4096
+
+// Longest time a message waits in the write batch of a file, 0 writes every message at once
+#define FLUSH_LATENCY_MS 5
+
+// Batch size that is written out without waiting for the flush
+#define BATCH_BYTES (64 * 1024)
+
+// Size after which a segmented channel moves on to a new segment file
+#define SEGMENT_BYTES (1 << 20)
+
+// Bytes of address space mapped at a time for reading a channel file
+#define MAP_WINDOW (64 << 20)
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared memory rings need lock-free 64 bit atomics");
+
+enum ChannelBackend
+{
+    FILE_BACKEND,
+    SEGMENT_BACKEND,
+    SHM_BACKEND,
+    MEMORY_BACKEND
+};
+
+// Messages of a channel between objects of the same process
+typedef deque<string> MemoryChannel;
+
+// Channel behind a file name, shared by everyone in the process
+inline MemoryChannel &memoryChannel(const string &fileName)
+{
+    static map<string, MemoryChannel> channels;
+    return channels[fileName];
+}
+
+// Layout of the ring at the start of the shared memory segment
+struct RingHeader
+{
+    // Bytes consumed so far, written only by the reader
+    atomic<uint64_t> head;
+    char padHead[64 - sizeof(atomic<uint64_t>)];
+
+    // Bytes produced so far, written only by the writer
+    atomic<uint64_t> tail;
+    char padTail[64 - sizeof(atomic<uint64_t>)];
+
+    // Records of a 4 byte length followed by the message
+    char data[RING_BYTES];
+};
+
+// Single producer, single consumer ring buffer of messages
+class ShmRing
+{
+public:
+    ShmRing() : ring(NULL), cachedHead(0), cachedTail(0), owner(false){};
+    ~ShmRing() { close(); };
+
+    // Map the ring, the owner starts it over empty
+    bool open(const string &, bool);
+
+    // Append a message, false at once if the ring is full
+    bool push(const char *, size_t);
+
+    // Take the oldest message, false if the ring is empty
+    bool pop(string &);
+
+    // Unmap the ring
+    void close();
+
+private:
+    // Mapped segment
+    RingHeader *ring;
+
+    // Name of the segment
+    string name;
+
+    // Last seen index of the other side
+    uint64_t cachedHead;
+    uint64_t cachedTail;
+
+    // Owner removes the segment on close
+    bool owner;
+
+    // Copy in and out of the ring with wrap around
+    void copyIn(uint64_t, const char *, size_t);
+    void copyOut(uint64_t, char *, size_t);
+};
+
+// Name of the segment behind a channel file, private to the working directory
+inline string shmName(const string &fileName)
+{
+    struct stat dir;
+    stat(".", &dir);
+    return "/cs6390_" + to_string(dir.st_ino) + "_" + fileName;
+}
+
+inline bool ShmRing::open(const string &fileName, bool create)
+{
+    name = shmName(fileName);
+    owner = create;
+
+    // The owner always gets a fresh, zeroed, and therefore empty ring
+    if (create)
+        shm_unlink(name.c_str());
+
+    int fd = shm_open(name.c_str(), O_RDWR | (create ? O_CREAT : 0), 0644);
+    if (fd < 0)
+        return false;
+
+    if (create && ftruncate(fd, sizeof(RingHeader)) < 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void *mem = mmap(NULL, sizeof(RingHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED)
+        return false;
+
+    ring = (RingHeader *)mem;
+    cachedHead = ring->head.load(memory_order_acquire);
+    cachedTail = ring->tail.load(memory_order_acquire);
+
+    return true;
+}
+
+inline void ShmRing::close()
+{
+    if (ring == NULL)
+        return;
+
+    munmap(ring, sizeof(RingHeader));
+    ring = NULL;
+
+    if (owner)
+        shm_unlink(name.c_str());
+}
+
+inline void ShmRing::copyIn(uint64_t pos, const char *src, size_t len)
+{
+    size_t offset = pos % RING_BYTES;
+    size_t first = min(len, (size_t)RING_BYTES - offset);
+
+    memcpy(ring->data + offset, src, first);
+    memcpy(ring->data, src + first, len - first);
+}
+
+inline void ShmRing::copyOut(uint64_t pos, char *dst, size_t len)
+{
+    size_t offset = pos % RING_BYTES;
+    size_t first = min(len, (size_t)RING_BYTES - offset);
+
+    memcpy(dst, ring->data + offset, first);
+    memcpy(dst + first, ring->data, len - first);
+}
+
+inline bool ShmRing::push(const char *message, size_t length)
+{
+    uint32_t len = length;
+    size_t need = sizeof(len) + len;
+    if (need > RING_BYTES)
+        return false;
+
+    // Only the writer moves the tail
+    uint64_t tail = ring->tail.load(memory_order_relaxed);
+
+    // Look at the reader again only when the cached view is full, the writer holds back what does not fit
+    if (RING_BYTES - (tail - cachedHead) < need)
+    {
+        cachedHead = ring->head.load(memory_order_acquire);
+        if (RING_BYTES - (tail - cachedHead) < need)
+            return false;
+    }
+
+    copyIn(tail, (const char *)&len, sizeof(len));
+    copyIn(tail + sizeof(len), message, len);
+
+    // Publish the record
+    ring->tail.store(tail + need, memory_order_release);
+
+    return true;
+}
+
+inline bool ShmRing::pop(string &message)
+{
+    // Only the reader moves the head
+    uint64_t head = ring->head.load(memory_order_relaxed);
+
+    if (head == cachedTail)
+    {
+        cachedTail = ring->tail.load(memory_order_acquire);
+        if (head == cachedTail)
+            return false;
+    }
+
+    uint32_t len;
+    copyOut(head, (char *)&len, sizeof(len));
+
+    message.resize(len);
+    copyOut(head + sizeof(len), &message[0], len);
+
+    // Hand the space back to the writer
+    ring->head.store(head + sizeof(len) + len, memory_order_release);
+
+    return true;
+}
+
+// Find the whole message that starts at start, and where the one after it starts
+inline bool nextFrame(WireFormat wire, const char *start, const char *end, MessageView &message, const char *&after)
+{
+    if (wire == BINARY_WIRE)
+    {
+        // A varint length and then the frame
+        const char *p = start;
+        uint64_t len;
+        if (!getVarint(p, end, len) || uint64_t(end - p) < len)
+            return false;
+
+        message.data = p;
+        message.length = len;
+        after = p + len;
+        return true;
+    }
+
+    // A line without the newline
+    const char *newline = (const char *)memchr(start, '\n', end - start);
+    if (newline == NULL)
+        return false;
+
+    message.data = start;
+    message.length = newline - start;
+    after = newline + 1;
+    return true;
+}
+
+// Reader of a channel file through a shared mapping, which sees what the writer appends
+class MappedFile
+{
+public:
+    MappedFile() : fd(-1), base(NULL), mapStart(0), mapLength(0), fileSize(0), cursor(0){};
+    ~MappedFile()
+    {
+        close();
+    };
+
+    // Open the file for reading from its start
+    bool open(const string &);
+
+    // Next whole message as a view into the mapping, valid until release
+    bool next(WireFormat, MessageView &);
+
+    // Unmap the windows that were replaced since the last release
+    void release();
+
+    // Unmap everything
+    void close();
+
+private:
+    int fd;
+
+    // Window of the file that is mapped, from a page boundary
+    char *base;
+    size_t mapStart;
+    size_t mapLength;
+
+    // Bytes in the file at the last look, only those are safe to touch
+    size_t fileSize;
+
+    // Offset of the next message in the file
+    size_t cursor;
+
+    // Windows still pointed into by views
+    vector<pair<char *, size_t>> retired;
+
+    // Map a window that starts at the page of the cursor
+    bool remap();
+};
+
+inline bool MappedFile::open(const string &fileName)
+{
+    fd = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    cursor = 0;
+    fileSize = 0;
+    return fd >= 0;
+}
+
+inline bool MappedFile::remap()
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t start = cursor - cursor % page;
+
+    // Past the end of the file is fine to map, as long as it is not touched
+    void *mem = mmap(NULL, MAP_WINDOW, PROT_READ, MAP_SHARED, fd, start);
+    if (mem == MAP_FAILED)
+        return false;
+
+    if (base != NULL)
+        retired.push_back(make_pair(base, mapLength));
+
+    base = (char *)mem;
+    mapStart = start;
+    mapLength = MAP_WINDOW;
+    return true;
+}
+
+inline bool MappedFile::next(WireFormat wire, MessageView &message)
+{
+    if (fd < 0)
+        return false;
+
+    for (int look = 0; look < 2; look++)
+    {
+        if (base != NULL && cursor >= mapStart)
+        {
+            // Only the bytes the file had at the last look
+            const char *start = base + (cursor - mapStart);
+            const char *end = base + (min(fileSize, mapStart + mapLength) - mapStart);
+            const char *after;
+
+            if (start <= end && nextFrame(wire, start, end, message, after))
+            {
+                cursor += after - start;
+                return true;
+            }
+        }
+
+        // Nothing whole is left, look at the file again
+        if (look)
+            break;
+
+        struct stat info;
+        if (fstat(fd, &info) < 0 || size_t(info.st_size) <= fileSize)
+            return false;
+        fileSize = info.st_size;
+
+        // A message that runs past the window gets a window of its own
+        if (base == NULL || fileSize > mapStart + mapLength)
+            if (!remap())
+                return false;
+    }
+
+    return false;
+}
+
+inline void MappedFile::release()
+{
+    for (size_t k = 0; k < retired.size(); k++)
+        munmap(retired[k].first, retired[k].second);
+    retired.clear();
+}
+
+inline void MappedFile::close()
+{
+    release();
+    if (base != NULL)
+        munmap(base, mapLength);
+    if (fd >= 0)
+        ::close(fd);
+
+    base = NULL;
+    fd = -1;
+}
+
+// Directory that holds the segments of a channel and nothing else, "input_3.d" of "input_3",
+// so a watch on it only fires for that channel
+inline string segmentDirectory(const string &name)
+{
+    return name + ".d";
+}
+
+// Check that a file of the directory is a segment, "12"
+inline bool isSegment(const char *fileName)
+{
+    if (*fileName == '\0')
+        return false;
+
+    for (const char *p = fileName; *p; p++)
+        if (*p < '0' || *p > '9')
+            return false;
+
+    return true;
+}
+
+// Channel split in segment files of about SEGMENT_BYTES, with one writer and one reader
+class SegmentLog
+{
+public:
+    SegmentLog() : fd(-1), offsetFd(-1), seq(0), offset(0), savedSeq(-1), savedOffset(-1){};
+    ~SegmentLog() { close(); };
+
+    // Open the reading side at the saved offset, the owner starts the log over empty
+    bool openReader(const string &, bool);
+
+    // Open the writing side at the last segment, the owner starts the log over empty
+    bool openWriter(const string &, bool);
+
+    // Read what is there, moving on to the next segment and deleting the one passed
+    ssize_t read(char *, size_t);
+
+    // Append to the last segment, starting a new one once it is full, and return the bytes that went in
+    size_t write(const char *, size_t);
+
+    // Save the offset and close the files
+    void close();
+
+private:
+    // Name of the channel, the segments are name.d/0, name.d/1, ... and the offset file name.offset
+    string name;
+
+    // Segment open for reading or writing
+    int fd;
+
+    // File with the segment and offset the reader got to
+    int offsetFd;
+
+    // Segment in use, and the bytes read or written in it
+    uint64_t seq;
+    uint64_t offset;
+
+    // Position in the offset file, to skip saving when nothing moved
+    uint64_t savedSeq;
+    uint64_t savedOffset;
+
+    string segmentName(uint64_t k) const { return segmentDirectory(name) + "/" + to_string(k); };
+
+    // Create the directory of the segments, false if there is none
+    bool makeDirectory();
+
+    // Remove every segment and the offset file
+    void removeAll();
+
+    // Write the reader position to the offset file
+    void saveOffset();
+
+    // Move the writer on to the next segment, false if it cannot be opened
+    bool rotate();
+};
+
+inline bool SegmentLog::makeDirectory()
+{
+    return mkdir(segmentDirectory(name).c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+inline void SegmentLog::removeAll()
+{
+    unlink((name + ".offset").c_str());
+
+    // The directory stays, as the other side may already watch it
+    DIR *dir = opendir(segmentDirectory(name).c_str());
+    if (dir == NULL)
+        return;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+        if (isSegment(entry->d_name))
+            unlink((segmentDirectory(name) + "/" + entry->d_name).c_str());
+
+    closedir(dir);
+}
+
+inline bool SegmentLog::openReader(const string &fileName, bool create)
+{
+    name = fileName;
+    seq = 0;
+    offset = 0;
+
+    if (!makeDirectory())
+        return false;
+
+    if (create)
+    {
+        removeAll();
+
+        // An empty first segment, so the writer has something to open
+        int first = ::open(segmentName(0).c_str(), O_WRONLY | O_CREAT, 0644);
+        if (first < 0)
+            return false;
+        ::close(first);
+    }
+
+    offsetFd = ::open((name + ".offset").c_str(), O_RDWR | O_CREAT, 0644);
+    if (offsetFd < 0)
+        return false;
+
+    // Start where the last reader stopped
+    uint64_t position[2];
+    if (pread(offsetFd, position, sizeof(position), 0) == sizeof(position))
+    {
+        seq = position[0];
+        offset = position[1];
+    }
+    saveOffset();
+
+    fd = ::open(segmentName(seq).c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    lseek(fd, offset, SEEK_SET);
+    return true;
+}
+
+inline bool SegmentLog::openWriter(const string &fileName, bool create)
+{
+    name = fileName;
+    seq = 0;
+
+    if (!makeDirectory())
+        return false;
+
+    if (create)
+        removeAll();
+
+    // Segments before the reader are gone, so start looking from there
+    int position = ::open((name + ".offset").c_str(), O_RDONLY);
+    if (position >= 0)
+    {
+        uint64_t readerSeq;
+        if (pread(position, &readerSeq, sizeof(readerSeq), 0) == sizeof(readerSeq))
+            seq = readerSeq;
+        ::close(position);
+    }
+
+    while (access(segmentName(seq + 1).c_str(), F_OK) == 0)
+        seq++;
+
+    fd = ::open(segmentName(seq).c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0)
+        return false;
+
+    offset = lseek(fd, 0, SEEK_END);
+    return true;
+}
+
+inline ssize_t SegmentLog::read(char *buffer, size_t size)
+{
+    while (true)
+    {
+        ssize_t got = ::read(fd, buffer, size);
+        if (got > 0)
+        {
+            offset += got;
+            return got;
+        }
+
+        // The writer only moves on from a full segment, and never comes back to it
+        if (offset < SEGMENT_BYTES || access(segmentName(seq + 1).c_str(), F_OK) != 0)
+        {
+            saveOffset();
+            return 0;
+        }
+
+        // Whatever was written before the next segment appeared
+        got = ::read(fd, buffer, size);
+        if (got > 0)
+        {
+            offset += got;
+            return got;
+        }
+
+        // Nobody needs this segment anymore
+        int next = ::open(segmentName(seq + 1).c_str(), O_RDONLY);
+        if (next < 0)
+            return 0;
+
+        ::close(fd);
+        unlink(segmentName(seq).c_str());
+        fd = next;
+        seq++;
+        offset = 0;
+        saveOffset();
+    }
+}
+
+inline size_t SegmentLog::write(const char *data, size_t size)
+{
+    // Nothing goes past a full segment, so the disk holds what it was meant to
+    if (offset >= SEGMENT_BYTES && !rotate())
+        return 0;
+
+    // A short write leaves the rest to the caller, which writes it right after
+    size_t done = 0;
+    while (done < size)
+    {
+        ssize_t wrote = ::write(fd, data + done, size - done);
+        if (wrote < 0 && errno == EINTR)
+            continue;
+        if (wrote <= 0)
+            break;
+        done += wrote;
+    }
+    offset += done;
+
+    // The reader goes on to the next segment as soon as it is done with this one
+    if (done == size && offset >= SEGMENT_BYTES)
+        rotate();
+
+    return done;
+}
+
+inline bool SegmentLog::rotate()
+{
+    // Everything of this segment is written before the next one exists
+    int next = ::open(segmentName(seq + 1).c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (next < 0)
+        return false;
+
+    ::close(fd);
+    fd = next;
+    seq++;
+    offset = 0;
+    return true;
+}
+
+inline void SegmentLog::saveOffset()
+{
+    if (offsetFd < 0 || (seq == savedSeq && offset == savedOffset))
+        return;
+
+    uint64_t position[2] = {seq, offset};
+    if (pwrite(offsetFd, position, sizeof(position), 0) == sizeof(position))
+    {
+        savedSeq = seq;
+        savedOffset = offset;
+    }
+}
+
+inline void SegmentLog::close()
+{
+    saveOffset();
+
+    if (fd >= 0)
+        ::close(fd);
+    if (offsetFd >= 0)
+        ::close(offsetFd);
+
+    fd = -1;
+    offsetFd = -1;
+}
+
+struct FileDescriptor
+{
+    // Store the name of the file
+    string inputFileName;
+    string outputFileName;
+
+    // Where the messages actually go
+    ChannelBackend backend = FILE_BACKEND;
+
+    // How messages are delimited in the files
+    WireFormat wire = TEXT_WIRE;
+
+    // File Descriptors
+    fstream input;
+    ofstream output;
+
+    // Input file as read through a mapping
+    MappedFile mappedInput;
+
+    // Segment logs
+    SegmentLog inputLog;
+    SegmentLog outputLog;
+
+    // Rings in shared memory
+    ShmRing inputRing;
+    ShmRing outputRing;
+
+    // Queues in the process
+    MemoryChannel *inputQueue = NULL;
+    MemoryChannel *outputQueue = NULL;
+
+    // Bytes read from the input segments that are not a whole message yet
+    string pending;
+    size_t pendingPos = 0;
+
+    // Last message taken off a ring or a queue, for the views to point into
+    string current;
+
+    // Messages written to the output file that are not flushed yet
+    string batch;
+    struct timespec batchStart;
+
+    // Messages a full ring had no room for, each after its length as a varint, in the order they were written
+    string unsent;
+
+    // Messages dropped because too many were held back already
+    Counter dropped;
+
+    // Bound on the time a message stays in the batch
+    long flushMs = FLUSH_LATENCY_MS;
+
+    // Open the reading side, the owner starts it over empty
+    bool openInput(bool);
+
+    // Open the writing side
+    bool openOutput(bool);
+
+    // Read the next message, false if there is none yet
+    bool readMessage(string &);
+
+    // Same, without a copy out of the read buffer, valid until the next read (until release for files)
+    bool readMessage(MessageView &);
+
+    // Let go of what the views of the past reads point into
+    void release() { mappedInput.release(); };
+
+    // Write a single message, batched with the others to the same file, false if it was dropped
+    bool writeMessage(const string &);
+    bool writeMessage(const MessageView &);
+
+    // Write out the batch with a single write, false if something is still held back
+    bool flush();
+
+    // Close both sides
+    void close();
+
+private:
+    // Take a whole message out of pending
+    bool takePending(MessageView &);
+};
+
+inline bool FileDescriptor::openInput(bool create)
+{
+    if (backend == SHM_BACKEND)
+        return inputRing.open(inputFileName, create);
+
+    if (backend == MEMORY_BACKEND)
+    {
+        inputQueue = &memoryChannel(inputFileName);
+        if (create)
+            inputQueue->clear();
+        return true;
+    }
+
+    if (backend == SEGMENT_BACKEND)
+        return inputLog.openReader(inputFileName, create);
+
+    // Truncate the file
+    if (create)
+    {
+        input.open(inputFileName.c_str(), ios::out);
+        input.close();
+    }
+
+    return mappedInput.open(inputFileName);
+}
+
+inline bool FileDescriptor::openOutput(bool create)
+{
+    if (backend == SHM_BACKEND)
+        return outputRing.open(outputFileName, create);
+
+    if (backend == MEMORY_BACKEND)
+    {
+        outputQueue = &memoryChannel(outputFileName);
+        if (create)
+            outputQueue->clear();
+        return true;
+    }
+
+    if (backend == SEGMENT_BACKEND)
+        return outputLog.openWriter(outputFileName, create);
+
+    output.open(outputFileName.c_str(), ios::out | ios::app | ios::binary);
+    return !output.fail();
+}
+
+inline bool FileDescriptor::takePending(MessageView &message)
+{
+    const char *after;
+    if (!nextFrame(wire, pending.data() + pendingPos, pending.data() + pending.length(), message, after))
+        return false;
+
+    pendingPos = after - pending.data();
+    return true;
+}
+
+inline bool FileDescriptor::readMessage(string &message)
+{
+    if (backend == SHM_BACKEND)
+        return inputRing.pop(message);
+
+    if (backend == MEMORY_BACKEND)
+    {
+        if (inputQueue->empty())
+            return false;
+
+        message.swap(inputQueue->front());
+        inputQueue->pop_front();
+        return true;
+    }
+
+    MessageView view;
+    if (!readMessage(view))
+        return false;
+
+    message.assign(view.data, view.length);
+    release();
+    return true;
+}
+
+inline bool FileDescriptor::readMessage(MessageView &message)
+{
+    if (backend == SHM_BACKEND || backend == MEMORY_BACKEND)
+    {
+        // Rings and queues hand out a copy, which the view then points into
+        if (!readMessage(current))
+            return false;
+
+        message.data = current.data();
+        message.length = current.length();
+        return true;
+    }
+
+    if (backend == FILE_BACKEND)
+        return mappedInput.next(wire, message);
+
+    while (!takePending(message))
+    {
+        // Drop what was already handed out
+        pending.erase(0, pendingPos);
+        pendingPos = 0;
+
+        // Reading the end only means that nothing new is there yet
+        char chunk[READ_CHUNK];
+        ssize_t got = inputLog.read(chunk, sizeof(chunk));
+        if (got <= 0)
+            return false;
+
+        pending.append(chunk, got);
+    }
+
+    return true;
+}
+
+inline bool FileDescriptor::writeMessage(const string &message)
+{
+    if (backend == MEMORY_BACKEND)
+    {
+        outputQueue->push_back(message);
+        return true;
+    }
+
+    MessageView view;
+    view.data = message.data();
+    view.length = message.length();
+    return writeMessage(view);
+}
+
+inline bool FileDescriptor::writeMessage(const MessageView &message)
+{
+    if (backend == SHM_BACKEND)
+    {
+        // A message larger than the ring never fits
+        if (message.length + sizeof(uint32_t) > RING_BYTES)
+        {
+            dropped++;
+            return false;
+        }
+
+        // Nothing may overtake the messages still held back
+        if (unsent.empty() && outputRing.push(message.data, message.length))
+            return true;
+
+        // The reader is too far behind, so the newest messages go
+        if (unsent.length() >= UNSENT_BYTES)
+        {
+            dropped++;
+            return false;
+        }
+
+        // Kept for the next flush
+        putVarint(unsent, message.length);
+        unsent.append(message.data, message.length);
+        return true;
+    }
+
+    if (backend == MEMORY_BACKEND)
+    {
+        outputQueue->push_back(string(message.data, message.length));
+        return true;
+    }
+
+    // The segment took nothing for too long
+    if (batch.length() >= UNSENT_BYTES)
+    {
+        dropped++;
+        return false;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (batch.empty())
+        batchStart = now;
+
+    if (wire == BINARY_WIRE)
+    {
+        putVarint(batch, message.length);
+        batch.append(message.data, message.length);
+    }
+    else
+    {
+        batch.append(message.data, message.length);
+        batch += '\n';
+    }
+
+    // Keep batching unless the oldest message waited long enough
+    long waited = (now.tv_sec - batchStart.tv_sec) * 1000 + (now.tv_nsec - batchStart.tv_nsec) / 1000000;
+    if (waited >= flushMs || batch.length() >= BATCH_BYTES)
+        flush();
+
+    return true;
+}
+
+inline bool FileDescriptor::flush()
+{
+    if (backend == SHM_BACKEND)
+    {
+        // Hand the ring whatever it has room for now, in order
+        const char *p = unsent.data();
+        const char *end = p + unsent.length();
+        while (p < end)
+        {
+            const char *record = p;
+            uint64_t length;
+            getVarint(record, end, length);
+            if (!outputRing.push(record, length))
+                break;
+            p = record + length;
+        }
+
+        unsent.erase(0, p - unsent.data());
+        return unsent.empty();
+    }
+
+    if (batch.empty())
+        return true;
+
+    if (backend == SEGMENT_BACKEND)
+    {
+        // What did not go in stays for the next flush, so a record is never left half written
+        batch.erase(0, outputLog.write(batch.data(), batch.length()));
+        return batch.empty();
+    }
+
+    output.write(batch.data(), batch.length());
+    output.flush(); //force
+    batch.clear();
+    return true;
+}
+
+inline void FileDescriptor::close()
+{
+    flush();
+    input.close();
+    output.close();
+    mappedInput.close();
+    inputLog.close();
+    outputLog.close();
+    inputRing.close();
+    outputRing.close();
+}
+
+// Parse the name of a backend given on the command line
+inline bool parseBackend(const char *name, ChannelBackend &backend)
+{
+    if (strcmp(name, "file") == 0)
+        backend = FILE_BACKEND;
+    else if (strcmp(name, "segment") == 0)
+        backend = SEGMENT_BACKEND;
+    else if (strcmp(name, "shm") == 0)
+        backend = SHM_BACKEND;
+    else
+        return false;
+
+    return true;
+}
+
+#endif
@@ -8,208 +8,97 @@
  *  To make it FOSS Compliant, this software is free to use.
  */
 
-// STL
-#include <iostream>
-#include <fstream>
-// SL
-#include <cstdlib>
-#include <cstring>
 // Unix
-#include <unistd.h>
+#include <getopt.h>
+#include <sys/resource.h>
+// Controller
+#include "controller.h"
 
 using namespace std;
 
-#define NUMNODES 10
-
-struct FileDescriptor
-{
-    // Store the name of the file
-    string inputFileName;
-    string outputFileName;
-
-    // File Descriptors
-    fstream input;
-    ofstream output;
-};
-
-class NodeRecord
-{
-public:
-    NodeRecord(){};
-    ~NodeRecord(){};
-
-    // Total number of nodes
-    size_t numNodes = 0;
-
-    // Channels of Controller
-    FileDescriptor *channels;
-
-    // Topology Links
-    int topologyLinks[NUMNODES][NUMNODES] = {{0}};
-
-    // Counter to check if the node is not responding
-    int nodeNotResponding[NUMNODES] = {0};
-
-    // Create the channels
-    void createChannels();
-};
-
-void NodeRecord::createChannels()
+int main(int argc, char *argv[])
 {
-    channels = new FileDescriptor[numNodes];
-
-    for (size_t i = 0; i < numNodes; i++)
+    // Check for the optional flags
+    bool eventDriven = false;
+    ControllerOptions options;
+    static struct option longOptions[] = {
+        {"event", no_argument, NULL, 'e'},
+        {"channel", required_argument, NULL, 'c'},
+        {"nodes", required_argument, NULL, 'n'},
+        {"wire", required_argument, NULL, 'w'},
+        {"threads", required_argument, NULL, 't'},
+        {"flush-ms", required_argument, NULL, 'f'},
+        {"stats", required_argument, NULL, 'p'},
+        {"events", required_argument, NULL, 'E'},
+        {"link", required_argument, NULL, 'L'},
+        {NULL, 0, NULL, 0}};
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "+ec:n:w:t:f:p:E:L:", longOptions, NULL)) != -1)
     {
-        // Give a name to the files
-        channels[i].inputFileName = string("output_") + char('0' + i);
-        channels[i].outputFileName = string("input_") + char('0' + i);
-
-        // Create the files
-        channels[i].input.open(channels[i].inputFileName.c_str(), ios::in);
-        channels[i].output.open(channels[i].outputFileName.c_str(), ios::out | ios::app);
-
-        if (channels[i].input.fail())
-        {
-            cout << "Controller: Node " << i << " No input file" << endl;
-            exit(1);
-        }
-        if (channels[i].output.fail())
+        bool valid = true;
+        switch (opt)
         {
-            cout << "Controller: Node " << i << " No output file" << endl;
-            exit(1);
+        case 'e':
+            eventDriven = true;
+            break;
+        case 'c':
+            valid = parseBackend(optarg, options.backend);
+            break;
+        case 'n':
+            options.numNodes = strtol(optarg, NULL, 10);
+            valid = (long)options.numNodes > 0;
+            break;
+        case 'w':
+            valid = parseWire(optarg, options.wire);
+            break;
+        case 't':
+            options.numThreads = strtol(optarg, NULL, 10);
+            valid = (long)options.numThreads > 0;
+            break;
+        case 'f':
+            options.flushMs = strtol(optarg, NULL, 10);
+            valid = options.flushMs >= 0;
+            break;
+        case 'p':
+            options.statsPeriod = strtol(optarg, NULL, 10);
+            valid = (long)options.statsPeriod > 0;
+            break;
+        case 'E':
+            options.eventsFile = optarg;
+            break;
+        case 'L':
+            valid = parseLinkModel(optarg, options.link);
+            break;
+        default:
+            valid = false;
         }
-    }
-}
-
-class Controller
-{
-public:
-    Controller(size_t duration) : duration(duration)
-    {
-        setChannel(); // topology
-        createNodeChannels(); // Node channels
-    };
-    ~Controller(){};
-
-    // Duration
-    size_t duration;
-
-    // beta function
-    void sendToNeighborsData();
-
-private:
-    // Channels of Controller
-    FileDescriptor channel;
 
-    // Node Record Entries
-    NodeRecord nodes;
-
-    // Init Channels
-    void setChannel();
-
-    //Create New Channels
-    void createNodeChannels();
-
-    //Parse the strings
-    void parseString(string);
-
-    // Read File
-    string readFile(fstream &);
-};
-
-void Controller::parseString(string line) //Waring: Single Sequencial Digit Parser only!!
-{
-    // Store the characters
-    char c1 = line[0];
-    char c2 = line[2];
-
-    if (unsigned(c1 - '0') + 1 > nodes.numNodes || unsigned(c2 - '0') + 1 > nodes.numNodes)
-    {
-        if ((c1 - '0') > (c2 - '0'))
-            nodes.numNodes = c1 - '0' + 1;
-        else
-            nodes.numNodes = c2 - '0' + 1;
-    }
-
-    nodes.topologyLinks[unsigned(c1 - '0')][unsigned(c2 - '0')] = 1;
-}
-
-void Controller::createNodeChannels()
-{
-    // Check and Parse the topology file
-    string line;
-    while (getline(channel.input, line) && !channel.input.eof())
-    {
-        parseString(line);
-    }
-
-    // Create the Channels
-    nodes.createChannels();
-}
-
-void Controller::setChannel()
-{
-    // Store the name of the file to open
-    channel.inputFileName = string("topology");
-    channel.outputFileName = "";
-
-    // Open the file as input
-    channel.input.open(channel.inputFileName.c_str(), ios::in);
-    if (channel.input.fail())
-    {
-        cout << "No file";
-        exit(1);
-    }
-}
-
-string Controller::readFile(fstream &fd)
-{
-    string line = "";
-    getline(fd, line);
-    if (fd.eof())
-    {
-        fd.clear();
-        line = "";
-    }
-    
-    return line;
-}
-
-void Controller::sendToNeighborsData()
-{
-    // Search through the topology links to find the neighbors
-    for (size_t i = 0; i < nodes.numNodes; i++)
-    {
-        // Read the output file of the node for the hello message
-        string line = "";
-        while((line = readFile(nodes.channels[i].input)) != "")
+        if (!valid)
         {
-            // Go through all the links of that particular nodes
-            for (size_t j = 0; j < nodes.numNodes; j++)
-            {
-                // If the link exist then put the message of that nodes input file
-                if (nodes.topologyLinks[i][j])
-                {
-                    nodes.channels[j].output << line << endl;
-                    nodes.channels[j].output.flush(); //force
-                }
-            }
+            cout << "Usage: controller [--event] [--channel file|segment|shm] [--nodes N] [--wire text|binary] [--threads T] [--flush-ms MS] [--stats SECONDS] [--events FILE] [--link delay=MS,bw=KBPS,queue=N,loss=P] Duration" << endl;
+            return -1;
         }
     }
-}
 
-int main(int argc, char *argv[])
-{
     //Check number of arguments
-    if (argc != 2)
+    if (argc - optind != 1)
     {
-        cout << "too " << (argc < 3 ? "few " : "many ") << "arguments passed" << endl;
+        cout << "too " << (argc - optind < 1 ? "few " : "many ") << "arguments passed" << endl;
         cout << "Requires: Duration" << endl;
         return -1;
     }
 
     //Convert Char Array to long int
-    long int arg = strtol(argv[1], NULL, 10);
+    long int arg = strtol(argv[optind], NULL, 10);
+
+    // Two files per node, so allow as many as the system lets us
+    struct rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0)
+    {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
 
     // Let the nodes get init
     sleep(1);
@@ -217,15 +106,18 @@ int main(int argc, char *argv[])
     cout << endl;
 
     //Create a node
-    Controller controller(arg);
+    Controller controller(arg, options);
 
     // Start the algo
-    for (size_t i = 0; i < controller.duration; i++)
+    if (eventDriven)
+    {
+        controller.runEventLoop();
+    }
+    else
     {
-        controller.sendToNeighborsData();
-        sleep(1);
+        controller.runPolling();
     }
     cout << "Controller Done" << endl;
 
     return 0;
-}
\ No newline at end of file
+}
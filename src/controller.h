@@ -0,0 +1,1200 @@
+/*
+ *  The controller of the network, which passes every message a node
+ *  writes to all the outgoing neighbors of that node.
+ *  Copyright (C) 2021 Sourabh J Choure
+ *
+ *  I promise that the work presented below is of my own.
+ *
+ *  To make it FOSS Compliant, this software is free to use.
+ */
+
+#ifndef CONTROLLER_H
+#define CONTROLLER_H
+
+// STL
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+// SL
+#include <cstdlib>
+#include <cstring>
+// Unix
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/inotify.h>
+// Channels
+#include "channel.h"
+// Counters
+#include "stats.h"
+// Timed topology changes
+#include "events.h"
+// Delay, bandwidth and loss of the links
+#include "link.h"
+
+using namespace std;
+
+// Longest sleep between two polls of idle rings
+#define RING_MAX_IDLE_US 1000
+
+// Point where a fixed number of threads wait for each other, reusable
+class Barrier
+{
+public:
+    Barrier(size_t count) : count(count), waiting(0), generation(0){};
+
+    // Block until every thread arrived
+    void wait();
+
+private:
+    mutex lock;
+    condition_variable arrived;
+    size_t count;
+    size_t waiting;
+    size_t generation;
+};
+
+inline void Barrier::wait()
+{
+    unique_lock<mutex> guard(lock);
+    size_t current = generation;
+
+    // The last one to arrive lets everyone go
+    if (++waiting == count)
+    {
+        waiting = 0;
+        generation++;
+        arrived.notify_all();
+        return;
+    }
+
+    arrived.wait(guard, [&] { return generation != current; });
+}
+
+// What a worker of the controller read in a pass, waiting for the owners of the destinations
+struct Shard
+{
+    // Messages read in this pass, their buffers are kept from pass to pass
+    vector<string> messages;
+    size_t used = 0;
+
+    // Index of the messages for every destination
+    vector<vector<size_t>> outbox;
+
+    // Destinations with something in their outbox
+    vector<size_t> touched;
+
+    // Messages for emulated links, as the index of the message, the source and the link of the source
+    struct Held
+    {
+        size_t message;
+        size_t source;
+        size_t link;
+    };
+    vector<Held> held;
+
+    // Number of messages read in this pass, their bytes, and the writes they make to the outboxes
+    size_t count = 0;
+    size_t bytes = 0;
+    size_t writes = 0;
+};
+
+// Settings of the controller given on the command line
+struct ControllerOptions
+{
+    // Total number of nodes, at least as many as in the topology
+    size_t numNodes = 0;
+
+    // Backend of the node channels
+    ChannelBackend backend = FILE_BACKEND;
+
+    // Framing of the messages in the node channels
+    WireFormat wire = TEXT_WIRE;
+
+    // Threads that forward
+    size_t numThreads = 1;
+
+    // Bound on the time a message waits in the write batch
+    long flushMs = FLUSH_LATENCY_MS;
+
+    // Seconds between two writes of the stats file, 0 for none
+    size_t statsPeriod = 0;
+
+    // Timed changes of the topology, none if empty
+    string eventsFile;
+
+    // What every link does unless the topology says otherwise
+    LinkModel link;
+};
+
+// Counters of the controller, written by the thread that runs the passes,
+// but for the messages read from every node, which the worker threads write
+struct ControllerStats
+{
+    ControllerStats(size_t numNodes) : readFrom(numNodes){};
+
+    // Messages read from the nodes, their bytes, and the writes to the neighbors,
+    // those over an emulated link once they arrive
+    Counter messagesRead;
+    Counter bytesRead;
+    Counter messagesWritten;
+
+    // Messages read from every node, each written by the thread that owns the node
+    vector<Counter> readFrom;
+
+    // Topology events applied, and the links they changed
+    Counter topologyEvents;
+    Counter linksChanged;
+
+    // Messages held back by an emulated link, lost on it, or dropped by its full queue
+    Counter messagesDelayed;
+    Counter messagesLost;
+    Counter messagesOverflowed;
+
+    // Messages on the way over the emulated links
+    Counter messagesInFlight;
+
+    // Time from the start of a pass that moved messages to its last write
+    Histogram passTime;
+};
+
+class NodeRecord
+{
+public:
+    NodeRecord(){};
+    ~NodeRecord(){};
+
+    // Total number of nodes
+    size_t numNodes = 0;
+
+    // Backend of the node channels
+    ChannelBackend backend = FILE_BACKEND;
+
+    // Framing of the messages in the node channels
+    WireFormat wire = TEXT_WIRE;
+
+    // Bound on the time a message waits in the write batch
+    long flushMs = FLUSH_LATENCY_MS;
+
+    // Channels of Controller
+    FileDescriptor *channels;
+
+    // Topology Links, the outgoing neighbors of every node
+    vector<vector<size_t>> topologyLinks;
+
+    // Cost of every topology link, 1 unless the topology gives one
+    vector<vector<uint32_t>> linkCosts;
+
+    // Delay, bandwidth, queue and loss of every topology link
+    vector<vector<LinkState>> linkStates;
+
+    // What a link does unless the topology says otherwise, links that come up too
+    LinkModel defaultLink;
+
+    // Links, costs and states as the topology file gives them, kept to heal (with events only)
+    vector<vector<size_t>> fileLinks;
+    vector<vector<uint32_t>> fileCosts;
+    vector<vector<LinkState>> fileStates;
+
+    // Counter to check if the node is not responding
+    vector<int> nodeNotResponding;
+
+    // Create the channels
+    void createChannels();
+
+    // Bring the link up, or give it a new cost, true if it changed
+    bool addLink(size_t, size_t, uint32_t);
+
+    // Take the link down, true if it was up
+    bool removeLink(size_t, size_t);
+};
+
+inline bool NodeRecord::addLink(size_t from, size_t to, uint32_t cost)
+{
+    vector<size_t> &links = topologyLinks[from];
+    size_t k = find(links.begin(), links.end(), to) - links.begin();
+
+    if (k == links.size())
+    {
+        links.push_back(to);
+        linkCosts[from].push_back(cost);
+        linkStates[from].push_back(LinkState(defaultLink));
+        return true;
+    }
+
+    if (linkCosts[from][k] == cost)
+        return false;
+
+    linkCosts[from][k] = cost;
+    return true;
+}
+
+inline bool NodeRecord::removeLink(size_t from, size_t to)
+{
+    vector<size_t> &links = topologyLinks[from];
+    size_t k = find(links.begin(), links.end(), to) - links.begin();
+    if (k == links.size())
+        return false;
+
+    links.erase(links.begin() + k);
+    linkCosts[from].erase(linkCosts[from].begin() + k);
+    linkStates[from].erase(linkStates[from].begin() + k);
+    return true;
+}
+
+inline void NodeRecord::createChannels()
+{
+    channels = new FileDescriptor[numNodes];
+
+    for (size_t i = 0; i < numNodes; i++)
+    {
+        // Give a name to the files
+        channels[i].inputFileName = "output_" + to_string(i);
+        channels[i].outputFileName = "input_" + to_string(i);
+
+        // Open the channels the node created
+        channels[i].backend = backend;
+        channels[i].wire = wire;
+        channels[i].flushMs = flushMs;
+
+        if (!channels[i].openInput(false))
+        {
+            cout << "Controller: Node " << i << " No input file" << endl;
+            exit(1);
+        }
+        if (!channels[i].openOutput(false))
+        {
+            cout << "Controller: Node " << i << " No output file" << endl;
+            exit(1);
+        }
+    }
+}
+
+class Controller
+{
+public:
+    Controller(size_t duration, const ControllerOptions &options) : duration(duration), numThreads(options.numThreads), statsPeriod(options.statsPeriod), startPass(numThreads), midPass(numThreads), endPass(numThreads)
+    {
+        nodes.backend = options.backend;
+        nodes.wire = options.wire;
+        nodes.flushMs = options.flushMs;
+        nodes.numNodes = options.numNodes;
+        nodes.defaultLink = options.link;
+        setChannel(); // topology
+        createNodeChannels(); // Node channels
+        stats = new ControllerStats(nodes.numNodes); // Counters
+        loadEvents(options.eventsFile); // Topology events
+        startWorkers(); // Threads
+    };
+    ~Controller();
+
+    // Duration
+    size_t duration;
+
+    // beta function
+    void sendToNeighborsData();
+
+    // Event-driven fan-out for the whole duration
+    void runEventLoop();
+
+    // A pass every second for the whole duration, delivering over the emulated links in between
+    void runPolling();
+
+    // Counters of the forwarding
+    ControllerStats *stats = NULL;
+
+    // Write the counters to controller_stats.prom
+    void exportStats();
+
+    // Microseconds on the clock of the topology events, the monotonic clock unless a simulation keeps its own
+    function<uint64_t()> clock = []() { return monotonicNs() / 1000; };
+
+    // Apply the topology events due by now, the first call starts their clock, and return how many there were
+    size_t applyEvents();
+
+    // Time the next topology event is due, false once every event was applied
+    bool eventDue(uint64_t &) const;
+
+    // Lines of the last topology events applied, joined by "; "
+    string lastEvents(size_t) const;
+
+    // Write the messages that arrived over the emulated links by now, and return how many
+    size_t deliverHeld();
+
+    // Time the next message may arrive over an emulated link, false if none is on the way
+    bool heldDue(uint64_t &at) const { return emulator.nextDue(at); };
+
+private:
+    // Channels of Controller
+    FileDescriptor channel;
+
+    // Node Record Entries
+    NodeRecord nodes;
+
+    // Message being forwarded, in place in the channel of the node
+    MessageView line;
+
+    // Hello with the cost of the link it goes over, reused to keep its buffer
+    string costHello;
+
+    // Messages on the way over the emulated links
+    LinkEmulator emulator;
+
+    // Send a message over link k of node i, holding it until it arrives, and share the copy through payload
+    void holdMessage(size_t, size_t, const char *, size_t, uint32_t &);
+
+    // Init Channels
+    void setChannel();
+
+    //Create New Channels
+    void createNodeChannels();
+
+    //Parse the strings
+    void parseString(string);
+
+    // Pass everything pending in the output file of one node to its neighbors
+    size_t forwardFromNode(size_t);
+
+    // Timed changes of the topology, and the next one to apply
+    vector<TopologyEvent> events;
+    size_t nextEvent = 0;
+
+    // Start of the clock of the events, set by the first applyEvents
+    uint64_t eventsOrigin = 0;
+    bool eventsStarted = false;
+
+    // Read the event file, once the topology gave the number of nodes
+    void loadEvents(const string &);
+
+    // Change the links as the event says, and return how many changed
+    size_t applyEvent(const TopologyEvent &);
+
+    // Poll the shared memory rings for the whole duration
+    void pollRings();
+
+    // Write out the batches of every node
+    void flushNodes();
+
+    // Threads that forward, the calling one included
+    size_t numThreads;
+
+    // Seconds between two writes of the stats file, 0 for none
+    size_t statsPeriod;
+
+    // Monotonic time of the next write of the stats file
+    uint64_t nextStatsNs = 0;
+
+    // Write the stats file if it is due
+    void maybeExportStats();
+
+    // Threads besides the calling one
+    vector<thread> workers;
+
+    // Work of every thread, source i is read by thread i % numThreads
+    vector<Shard> shards;
+
+    // Sources to read in the next parallel pass
+    vector<char> dirty;
+
+    // Meeting points of the threads in a pass
+    Barrier startPass;
+    Barrier midPass;
+    Barrier endPass;
+
+    // Set to let the workers exit
+    bool stopping = false;
+
+    // Start the worker threads
+    void startWorkers();
+
+    // Forward from every node, in parallel when there are threads
+    size_t forwardAll();
+
+    // Forward from the dirty nodes with every thread
+    size_t forwardParallel();
+
+    // Part of a parallel pass done by one thread
+    void runShard(size_t);
+
+    // Loop of a worker thread
+    void worker(size_t);
+};
+
+inline Controller::~Controller()
+{
+    // Leave the final counters behind
+    if (statsPeriod)
+        exportStats();
+
+    if (!workers.empty())
+    {
+        // Wake the workers up with nothing to do but exit
+        stopping = true;
+        startPass.wait();
+
+        for (size_t w = 0; w < workers.size(); w++)
+            workers[w].join();
+    }
+
+    delete stats;
+}
+
+inline void Controller::startWorkers()
+{
+    if (numThreads < 2)
+        return;
+
+    shards.resize(numThreads);
+    for (size_t w = 0; w < numThreads; w++)
+        shards[w].outbox.resize(nodes.numNodes);
+
+    dirty.assign(nodes.numNodes, 0);
+
+    // The calling thread works as thread 0
+    for (size_t w = 1; w < numThreads; w++)
+        workers.push_back(thread(&Controller::worker, this, w));
+}
+
+inline void Controller::worker(size_t w)
+{
+    while (true)
+    {
+        startPass.wait();
+        if (stopping)
+            return;
+
+        runShard(w);
+    }
+}
+
+inline void Controller::runShard(size_t w)
+{
+    Shard &shard = shards[w];
+
+    // Forget the last pass, everyone is done with it
+    for (size_t k = 0; k < shard.touched.size(); k++)
+        shard.outbox[shard.touched[k]].clear();
+    shard.touched.clear();
+    shard.held.clear();
+    shard.used = 0;
+    shard.count = 0;
+    shard.bytes = 0;
+    shard.writes = 0;
+
+    // Read the sources this thread owns
+    for (size_t i = w; i < nodes.numNodes; i += numThreads)
+    {
+        if (!dirty[i])
+            continue;
+        dirty[i] = 0;
+
+        while (true)
+        {
+            if (shard.used == shard.messages.size())
+                shard.messages.push_back(string());
+            if (!nodes.channels[i].readMessage(shard.messages[shard.used]))
+                break;
+
+            size_t read = shard.used++;
+            bool hello = isHello(nodes.wire, shard.messages[read].data(), shard.messages[read].length());
+            shard.bytes += shard.messages[read].length();
+
+            // Leave the message for the owners of the neighbors
+            for (size_t k = 0; k < nodes.topologyLinks[i].size(); k++)
+            {
+                size_t dest = nodes.topologyLinks[i][k];
+                size_t index = read;
+
+                // A hello over a link that costs more gets its own copy with the cost
+                if (hello && nodes.linkCosts[i][k] != 1)
+                {
+                    if (shard.used == shard.messages.size())
+                        shard.messages.push_back(string());
+                    addLinkCost(nodes.wire, shard.messages[read].data(), shard.messages[read].length(), nodes.linkCosts[i][k], shard.messages[shard.used]);
+                    index = shard.used++;
+                }
+
+                // An emulated link is left to the thread that runs the passes
+                if (nodes.linkStates[i][k].model.emulated())
+                {
+                    Shard::Held held = {index, i, k};
+                    shard.held.push_back(held);
+                    continue;
+                }
+
+                if (shard.outbox[dest].empty())
+                    shard.touched.push_back(dest);
+                shard.outbox[dest].push_back(index);
+                shard.writes++;
+            }
+
+            shard.count++;
+            stats->readFrom[i]++;
+        }
+    }
+
+    // Wait until every message of the pass is read
+    midPass.wait();
+
+    // Write to the destinations this thread owns, so every channel has a single writer
+    for (size_t dest = w; dest < nodes.numNodes; dest += numThreads)
+    {
+        for (size_t s = 0; s < numThreads; s++)
+        {
+            const vector<size_t> &outbox = shards[s].outbox[dest];
+            for (size_t k = 0; k < outbox.size(); k++)
+                nodes.channels[dest].writeMessage(shards[s].messages[outbox[k]]);
+        }
+
+        // A single write per destination and pass
+        nodes.channels[dest].flush();
+    }
+
+    endPass.wait();
+}
+
+inline size_t Controller::forwardParallel()
+{
+    uint64_t start = monotonicNs();
+    startPass.wait();
+    runShard(0);
+
+    // The workers wait for the next pass, so the emulated links are only used by this thread
+    for (size_t w = 0; w < numThreads; w++)
+    {
+        // The copies of a message share what they hold
+        uint32_t payload = LINK_NONE;
+        for (size_t k = 0; k < shards[w].held.size(); k++)
+        {
+            const Shard::Held &held = shards[w].held[k];
+            if (k > 0 && held.message != shards[w].held[k - 1].message)
+                payload = LINK_NONE;
+
+            const string &message = shards[w].messages[held.message];
+            holdMessage(held.source, held.link, message.data(), message.length(), payload);
+        }
+    }
+
+    size_t count = 0;
+    for (size_t w = 0; w < numThreads; w++)
+    {
+        count += shards[w].count;
+        stats->bytesRead += shards[w].bytes;
+        stats->messagesWritten += shards[w].writes;
+    }
+
+    stats->messagesRead += count;
+    if (count)
+        stats->passTime.observe(monotonicNs() - start);
+
+    return count;
+}
+
+inline size_t Controller::forwardAll()
+{
+    // The workers wait for the pass, so the links are only changed in between
+    applyEvents();
+
+    // What arrived over the emulated links goes before what was read since
+    deliverHeld();
+
+    if (!workers.empty())
+    {
+        dirty.assign(nodes.numNodes, 1);
+        return forwardParallel();
+    }
+
+    uint64_t start = monotonicNs();
+    size_t count = 0;
+    for (size_t i = 0; i < nodes.numNodes; i++)
+        count += forwardFromNode(i);
+
+    flushNodes();
+
+    if (count)
+        stats->passTime.observe(monotonicNs() - start);
+
+    return count;
+}
+
+inline void Controller::flushNodes()
+{
+    for (size_t i = 0; i < nodes.numNodes; i++)
+        nodes.channels[i].flush();
+}
+
+inline void Controller::parseString(string line)
+{
+    // Store the two ends of the link, and its cost if there is one
+    const char *start = line.c_str();
+    char *end;
+
+    long c1 = strtol(start, &end, 10);
+    if (end == start || c1 < 0)
+        return;
+
+    start = end;
+    long c2 = strtol(start, &end, 10);
+    if (end == start || c2 < 0)
+        return;
+
+    start = end;
+    long cost = strtol(start, &end, 10);
+    if (end == start)
+        cost = 1;
+
+    // What the link does, the default unless the line says otherwise
+    LinkState state(nodes.defaultLink);
+    istringstream settings(end);
+    string setting;
+    while (settings >> setting)
+        parseLinkSetting(setting, state.model);
+
+    if (size_t(c1) + 1 > nodes.numNodes || size_t(c2) + 1 > nodes.numNodes)
+    {
+        if (c1 > c2)
+            nodes.numNodes = c1 + 1;
+        else
+            nodes.numNodes = c2 + 1;
+    }
+
+    if (nodes.topologyLinks.size() < nodes.numNodes)
+    {
+        nodes.topologyLinks.resize(nodes.numNodes);
+        nodes.linkCosts.resize(nodes.numNodes);
+        nodes.linkStates.resize(nodes.numNodes);
+    }
+
+    // Add the link once
+    vector<size_t> &links = nodes.topologyLinks[c1];
+    if (find(links.begin(), links.end(), size_t(c2)) == links.end())
+    {
+        links.push_back(c2);
+        nodes.linkCosts[c1].push_back(clampCost(max(cost, 0L)));
+        nodes.linkStates[c1].push_back(state);
+    }
+}
+
+inline void Controller::createNodeChannels()
+{
+    // Check and Parse the topology file
+    string line;
+    while (getline(channel.input, line) && !channel.input.eof())
+    {
+        parseString(line);
+    }
+
+    // Nodes without any link get channels too
+    nodes.topologyLinks.resize(nodes.numNodes);
+    nodes.linkCosts.resize(nodes.numNodes);
+    nodes.linkStates.resize(nodes.numNodes);
+    nodes.nodeNotResponding.resize(nodes.numNodes, 0);
+
+    // Create the Channels
+    nodes.createChannels();
+}
+
+inline void Controller::setChannel()
+{
+    // Store the name of the file to open
+    channel.inputFileName = string("topology");
+    channel.outputFileName = "";
+
+    // Open the file as input
+    channel.input.open(channel.inputFileName.c_str(), ios::in);
+    if (channel.input.fail())
+    {
+        cout << "No file";
+        exit(1);
+    }
+}
+
+inline void Controller::loadEvents(const string &fileName)
+{
+    if (fileName.empty())
+        return;
+
+    if (!loadTopologyEvents(fileName, nodes.numNodes, events))
+    {
+        cout << "Controller: cannot read the events " << fileName << endl;
+        exit(1);
+    }
+
+    // Heal goes back to the links as they are now
+    nodes.fileLinks = nodes.topologyLinks;
+    nodes.fileCosts = nodes.linkCosts;
+    nodes.fileStates = nodes.linkStates;
+}
+
+inline string Controller::lastEvents(size_t count) const
+{
+    string lines;
+    for (size_t k = nextEvent - min(count, nextEvent); k < nextEvent; k++)
+    {
+        if (!lines.empty())
+            lines += "; ";
+        lines += events[k].text;
+    }
+
+    return lines;
+}
+
+inline bool Controller::eventDue(uint64_t &at) const
+{
+    if (nextEvent == events.size())
+        return false;
+
+    at = eventsOrigin + events[nextEvent].at;
+    return true;
+}
+
+inline size_t Controller::applyEvents()
+{
+    if (nextEvent == events.size())
+        return 0;
+
+    uint64_t now = clock();
+    if (!eventsStarted)
+    {
+        eventsOrigin = now;
+        eventsStarted = true;
+    }
+
+    size_t applied = 0;
+    while (nextEvent < events.size() && eventsOrigin + events[nextEvent].at <= now)
+    {
+        const TopologyEvent &event = events[nextEvent++];
+        size_t changed = applyEvent(event);
+
+        stats->topologyEvents++;
+        stats->linksChanged += changed;
+        applied++;
+
+        // The time it really took effect, which the pass may have delayed
+        ostringstream log;
+        log.setf(ios::fixed);
+        log.precision(6);
+        log << "Controller: " << double(clock() - eventsOrigin) / EVENTS_SECOND << " s " << event.text << ", " << changed << " links changed";
+        cout << log.str() << endl;
+    }
+
+    return applied;
+}
+
+inline size_t Controller::applyEvent(const TopologyEvent &event)
+{
+    size_t changed = 0;
+
+    switch (event.kind)
+    {
+    case LINK_UP:
+        changed += nodes.addLink(event.from, event.to, clampCost(event.cost));
+        break;
+
+    case LINK_DOWN:
+        changed += nodes.removeLink(event.from, event.to);
+        break;
+
+    case NODE_ISOLATE:
+        // Everything it hears and everyone who hears it
+        for (size_t i = 0; i < nodes.numNodes; i++)
+            changed += nodes.removeLink(i, event.from);
+        while (!nodes.topologyLinks[event.from].empty())
+            changed += nodes.removeLink(event.from, nodes.topologyLinks[event.from].back());
+        break;
+
+    case PARTITION:
+    {
+        vector<char> inside(nodes.numNodes, 0);
+        for (size_t k = 0; k < event.group.size(); k++)
+            inside[event.group[k]] = 1;
+
+        // Only the links that cross the cut go
+        for (size_t i = 0; i < nodes.numNodes; i++)
+        {
+            vector<size_t> &links = nodes.topologyLinks[i];
+            for (size_t k = links.size(); k-- > 0;)
+                if (inside[i] != inside[links[k]])
+                    changed += nodes.removeLink(i, links[k]);
+        }
+        break;
+    }
+
+    case HEAL:
+        // Count what differs from the topology file before going back to it
+        for (size_t i = 0; i < nodes.numNodes; i++)
+        {
+            for (size_t k = 0; k < nodes.fileLinks[i].size(); k++)
+            {
+                size_t j = find(nodes.topologyLinks[i].begin(), nodes.topologyLinks[i].end(), nodes.fileLinks[i][k]) - nodes.topologyLinks[i].begin();
+                if (j == nodes.topologyLinks[i].size() || nodes.linkCosts[i][j] != nodes.fileCosts[i][k])
+                    changed++;
+            }
+            for (size_t k = 0; k < nodes.topologyLinks[i].size(); k++)
+                if (find(nodes.fileLinks[i].begin(), nodes.fileLinks[i].end(), nodes.topologyLinks[i][k]) == nodes.fileLinks[i].end())
+                    changed++;
+        }
+
+        nodes.topologyLinks = nodes.fileLinks;
+        nodes.linkCosts = nodes.fileCosts;
+        nodes.linkStates = nodes.fileStates;
+        break;
+    }
+
+    return changed;
+}
+
+inline size_t Controller::forwardFromNode(size_t i)
+{
+    size_t count = 0;
+
+    // Read the output file of the node for the hello message
+    while (nodes.channels[i].readMessage(line))
+    {
+        count++;
+        stats->bytesRead += line.length;
+        bool hello = isHello(nodes.wire, line.data, line.length);
+
+        // Copy held by the emulated links, made by the first of them
+        uint32_t payload = LINK_NONE;
+
+        // Go through all the links of that particular nodes
+        for (size_t k = 0; k < nodes.topologyLinks[i].size(); k++)
+        {
+            bool emulated = nodes.linkStates[i][k].model.emulated();
+
+            // A hello tells the neighbor what the link costs, when it is not 1
+            if (hello && nodes.linkCosts[i][k] != 1)
+            {
+                addLinkCost(nodes.wire, line.data, line.length, nodes.linkCosts[i][k], costHello);
+
+                // The cost is of this link only, so the copy is too
+                uint32_t own = LINK_NONE;
+                if (emulated)
+                {
+                    holdMessage(i, k, costHello.data(), costHello.length(), own);
+                }
+                else
+                {
+                    nodes.channels[nodes.topologyLinks[i][k]].writeMessage(costHello);
+                    stats->messagesWritten++;
+                }
+                continue;
+            }
+
+            // An emulated link holds the message until it arrives
+            if (emulated)
+            {
+                holdMessage(i, k, line.data, line.length, payload);
+                continue;
+            }
+
+            // Put the message in the input file of the neighbor
+            nodes.channels[nodes.topologyLinks[i][k]].writeMessage(line);
+            stats->messagesWritten++;
+        }
+    }
+
+    // The neighbors have their copies
+    nodes.channels[i].release();
+
+    stats->messagesRead += count;
+    stats->readFrom[i] += count;
+    return count;
+}
+
+inline void Controller::holdMessage(size_t i, size_t k, const char *data, size_t len, uint32_t &payload)
+{
+    uint64_t now = clock();
+    uint64_t arrival = now;
+
+    switch (emulator.send(nodes.linkStates[i][k], len, now, arrival))
+    {
+    case LINK_FULL:
+        stats->messagesOverflowed++;
+        return;
+    case LINK_LOST:
+        stats->messagesLost++;
+        return;
+    case LINK_PASSED:
+        break;
+    }
+
+    // Every link the message goes over holds the same copy
+    if (payload == LINK_NONE)
+        payload = emulator.share(data, len);
+    emulator.hold(nodes.topologyLinks[i][k], payload, arrival, now);
+
+    stats->messagesDelayed++;
+    stats->messagesInFlight.set(emulator.size());
+}
+
+inline size_t Controller::deliverHeld()
+{
+    if (emulator.size() == 0)
+        return 0;
+
+    size_t count = emulator.deliver(clock(), [this](size_t dest, const string &message) { nodes.channels[dest].writeMessage(message); });
+    if (count)
+    {
+        // The messages arrive as soon as they are due
+        flushNodes();
+        stats->messagesWritten += count;
+        stats->messagesInFlight.set(emulator.size());
+    }
+
+    return count;
+}
+
+inline void Controller::runPolling()
+{
+    for (size_t i = 0; i < duration; i++)
+    {
+        sendToNeighborsData();
+
+        // Sleep a second, but wake up for every message that arrives meanwhile
+        uint64_t wakeAt = clock() + 1000000;
+        for (uint64_t current = clock(); current < wakeAt; current = clock())
+        {
+            uint64_t due;
+            uint64_t until = wakeAt;
+            if (heldDue(due))
+                until = min(until, max(due, current));
+
+            struct timespec pause = {time_t((until - current) / 1000000), long((until - current) % 1000000 * 1000)};
+            nanosleep(&pause, NULL);
+            deliverHeld();
+        }
+    }
+}
+
+inline void Controller::sendToNeighborsData()
+{
+    // Search through the topology links to find the neighbors
+    forwardAll();
+
+    maybeExportStats();
+}
+
+inline void Controller::maybeExportStats()
+{
+    if (!statsPeriod)
+        return;
+
+    uint64_t now = monotonicNs();
+    if (now < nextStatsNs)
+        return;
+
+    exportStats();
+    nextStatsNs = now + statsPeriod * 1000000000ULL;
+}
+
+inline void Controller::exportStats()
+{
+    StatsFile file;
+
+    file.describe("cs6390_controller_messages_read_total", "counter", "Messages read from the nodes.");
+    file.sample("cs6390_controller_messages_read_total", "", stats->messagesRead);
+
+    file.describe("cs6390_controller_bytes_read_total", "counter", "Bytes of the messages read from the nodes.");
+    file.sample("cs6390_controller_bytes_read_total", "", stats->bytesRead);
+
+    file.describe("cs6390_controller_messages_written_total", "counter", "Messages written to the outgoing neighbors.");
+    file.sample("cs6390_controller_messages_written_total", "", stats->messagesWritten);
+
+    file.describe("cs6390_controller_node_messages_read_total", "counter", "Messages read from every node.");
+    for (size_t i = 0; i < nodes.numNodes; i++)
+        file.sample("cs6390_controller_node_messages_read_total", "node=\"" + to_string(i) + "\"", stats->readFrom[i]);
+
+    file.describe("cs6390_controller_channel_dropped_total", "counter", "Messages to every node dropped after holding back too many for a full ring or segment.");
+    for (size_t i = 0; i < nodes.numNodes; i++)
+        file.sample("cs6390_controller_channel_dropped_total", "node=\"" + to_string(i) + "\"", nodes.channels[i].dropped);
+
+    file.describe("cs6390_controller_topology_events_total", "counter", "Topology events applied.");
+    file.sample("cs6390_controller_topology_events_total", "", stats->topologyEvents);
+
+    file.describe("cs6390_controller_links_changed_total", "counter", "Links the topology events took down, brought up or gave a new cost.");
+    file.sample("cs6390_controller_links_changed_total", "", stats->linksChanged);
+
+    file.describe("cs6390_controller_messages_delayed_total", "counter", "Messages held back by an emulated link until they arrive.");
+    file.sample("cs6390_controller_messages_delayed_total", "", stats->messagesDelayed);
+
+    file.describe("cs6390_controller_link_drops_total", "counter", "Messages an emulated link dropped, by reason.");
+    file.sample("cs6390_controller_link_drops_total", "reason=\"loss\"", stats->messagesLost);
+    file.sample("cs6390_controller_link_drops_total", "reason=\"queue\"", stats->messagesOverflowed);
+
+    file.describe("cs6390_controller_messages_in_flight", "gauge", "Messages on the way over the emulated links.");
+    file.sample("cs6390_controller_messages_in_flight", "", stats->messagesInFlight);
+
+    file.describe("cs6390_controller_pass_seconds", "histogram", "Fan-out latency of a pass that moved messages.");
+    file.histogram("cs6390_controller_pass_seconds", "threads=\"" + to_string(numThreads) + "\"", stats->passTime);
+
+    file.save("controller_stats.prom");
+}
+
+inline void Controller::pollRings()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    time_t deadline = now.tv_sec + duration;
+
+    // Back off while the rings stay empty
+    useconds_t idle = 0;
+
+    while (now.tv_sec < deadline || (now.tv_sec == deadline && idle == 0))
+    {
+        size_t count = forwardAll();
+        maybeExportStats();
+
+        if (count)
+            idle = 0;
+        else if (idle < RING_MAX_IDLE_US)
+            idle = idle ? idle * 2 : 1;
+
+        if (idle)
+            usleep(idle);
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    }
+}
+
+inline void Controller::runEventLoop()
+{
+    // Shared memory has nothing to watch
+    if (nodes.backend == SHM_BACKEND)
+    {
+        pollRings();
+        return;
+    }
+
+    // Watch the output files of the nodes for appended lines
+    int notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (notifyFd < 0)
+    {
+        cout << "Controller: inotify unavailable" << endl;
+        exit(1);
+    }
+
+    // Map the watch descriptors back to the nodes
+    vector<size_t> watches;
+    for (size_t i = 0; i < nodes.numNodes; i++)
+    {
+        // Segments come and go, so their directory is watched, which holds nothing else
+        const string &name = nodes.channels[i].inputFileName;
+        int wd;
+        if (nodes.backend == SEGMENT_BACKEND)
+            wd = inotify_add_watch(notifyFd, segmentDirectory(name).c_str(), IN_MODIFY | IN_CREATE);
+        else
+            wd = inotify_add_watch(notifyFd, name.c_str(), IN_MODIFY);
+        if (wd < 0)
+        {
+            cout << "Controller: Node " << i << " cannot watch input file" << endl;
+            exit(1);
+        }
+
+        watches.resize(max(watches.size(), size_t(wd) + 1), nodes.numNodes);
+        watches[wd] = i;
+    }
+
+    // Pass whatever was written before the watches existed
+    sendToNeighborsData();
+
+    // Stop after the same number of seconds as the polling loop
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    time_t deadline = now.tv_sec + duration;
+    long deadlineNsec = now.tv_nsec;
+
+    // Buffer for the inotify events
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    while (true)
+    {
+        // Time left before the controller is done
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long long timeout = (deadline - now.tv_sec) * 1000LL + (deadlineNsec - now.tv_nsec) / 1000000;
+        if (timeout <= 0)
+            break;
+
+        // Wake up in time for the stats file
+        maybeExportStats();
+        if (statsPeriod)
+            timeout = min(timeout, (long long)statsPeriod * 1000);
+
+        // And for the next topology event
+        applyEvents();
+        uint64_t due;
+        if (eventDue(due))
+        {
+            uint64_t current = clock();
+            timeout = min(timeout, (long long)(due > current ? (due - current + 999) / 1000 : 0));
+        }
+
+        // And for the next message over an emulated link
+        deliverHeld();
+        if (heldDue(due))
+        {
+            uint64_t current = clock();
+            timeout = min(timeout, (long long)(due > current ? (due - current + 999) / 1000 : 0));
+        }
+
+        // Sleep until a node appends something
+        struct pollfd pfd = {notifyFd, POLLIN, 0};
+        if (poll(&pfd, 1, timeout) <= 0)
+            continue;
+
+        ssize_t len = read(notifyFd, events, sizeof(events));
+        if (len <= 0)
+            continue;
+
+        // Forward from every node that got modified
+        uint64_t start = monotonicNs();
+        size_t count = 0;
+        for (char *ptr = events; ptr < events + len;)
+        {
+            struct inotify_event *event = (struct inotify_event *)ptr;
+
+            // Node whose output changed, numNodes if none
+            size_t i = nodes.numNodes;
+            if (event->wd >= 0 && size_t(event->wd) < watches.size())
+                i = watches[event->wd];
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                // Lost track of the events, so check everyone
+                sendToNeighborsData();
+            }
+            else if (i < nodes.numNodes)
+            {
+                // With threads, the modified nodes are forwarded together
+                if (workers.empty())
+                    count += forwardFromNode(i);
+                else
+                    dirty[i] = 1;
+            }
+
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+
+        if (workers.empty())
+        {
+            flushNodes();
+            if (count)
+                stats->passTime.observe(monotonicNs() - start);
+        }
+        else
+        {
+            forwardParallel();
+        }
+    }
+
+    close(notifyFd);
+}
+
+#endif
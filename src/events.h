@@ -0,0 +1,167 @@
+/*
+ *  Timed changes of the topology, which the controller applies to its
+ *  links while the nodes run, to measure how fast they reconverge.
+ *  Copyright (C) 2021 Sourabh J Choure
+ *
+ *  I promise that the work presented below is of my own.
+ *
+ *  To make it FOSS Compliant, this software is free to use.
+ */
+
+#ifndef EVENTS_H
+#define EVENTS_H
+
+// STL
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+// SL
+#include <cstdlib>
+#include <stdint.h>
+
+using namespace std;
+
+// Times of the events are kept in microseconds
+#define EVENTS_SECOND 1000000ULL
+
+// What an event does to the links
+enum TopologyEventKind
+{
+    // The link from one node to another comes up, or takes a new cost
+    LINK_UP,
+    // The link from one node to another goes down
+    LINK_DOWN,
+    // Every link into and out of a node goes down
+    NODE_ISOLATE,
+    // Every link between a group of nodes and the rest goes down
+    PARTITION,
+    // The links go back to the topology file
+    HEAL
+};
+
+// A line of the event file
+struct TopologyEvent
+{
+    // Microseconds after the start of the controller
+    uint64_t at;
+    TopologyEventKind kind;
+
+    // Ends of the link, or the node to isolate
+    size_t from = 0;
+    size_t to = 0;
+
+    // Cost of a link that comes up
+    uint64_t cost = 1;
+
+    // Nodes on one side of a partition
+    vector<size_t> group;
+
+    // The line without its time, for the log
+    string text;
+};
+
+// Read a whole number from the next word, false if the word is anything else
+inline bool readNumber(istream &words, uint64_t &value)
+{
+    string word;
+    if (!(words >> word) || word[0] < '0' || word[0] > '9')
+        return false;
+
+    char *end;
+    value = strtoull(word.c_str(), &end, 10);
+    return *end == '\0';
+}
+
+// Read a node of the topology from the next word
+inline bool readNode(istream &words, size_t numNodes, size_t &node)
+{
+    uint64_t value;
+    if (!readNumber(words, value) || value >= numNodes)
+        return false;
+
+    node = value;
+    return true;
+}
+
+// Read the events, one "seconds event" per line, and sort them by time
+// The events are "up A B [cost]", "down A B", "isolate N", "partition N..." and "heal"
+inline bool loadTopologyEvents(const string &fileName, size_t numNodes, vector<TopologyEvent> &events)
+{
+    ifstream file(fileName.c_str());
+    if (file.fail())
+        return false;
+
+    string line;
+    while (getline(file, line))
+    {
+        // Skip comments and empty lines
+        istringstream words(line);
+        string first;
+        if (!(words >> first) || first[0] == '#')
+            continue;
+
+        TopologyEvent event;
+        char *end;
+        double seconds = strtod(first.c_str(), &end);
+        if (*end != '\0' || seconds < 0)
+            return false;
+        event.at = seconds * EVENTS_SECOND;
+
+        string kind;
+        words >> kind;
+        if (kind == "up" || kind == "down")
+        {
+            event.kind = (kind == "up") ? LINK_UP : LINK_DOWN;
+            if (!readNode(words, numNodes, event.from) || !readNode(words, numNodes, event.to) || event.from == event.to)
+                return false;
+
+            // A link that comes up may say what it costs, at least 1
+            if (event.kind == LINK_UP && !(words >> ws).eof() && (!readNumber(words, event.cost) || event.cost == 0))
+                return false;
+        }
+        else if (kind == "isolate")
+        {
+            event.kind = NODE_ISOLATE;
+            if (!readNode(words, numNodes, event.from))
+                return false;
+        }
+        else if (kind == "partition")
+        {
+            event.kind = PARTITION;
+            size_t node;
+            while (!(words >> ws).eof())
+            {
+                if (!readNode(words, numNodes, node))
+                    return false;
+                event.group.push_back(node);
+            }
+            if (event.group.empty())
+                return false;
+        }
+        else if (kind == "heal")
+        {
+            event.kind = HEAL;
+        }
+        else
+        {
+            return false;
+        }
+
+        // Nothing may follow the event
+        if (!(words >> ws).eof())
+            return false;
+
+        // Everything after the time, as written
+        event.text = line.substr(line.find(first) + first.length());
+        event.text.erase(0, event.text.find_first_not_of(" \t"));
+        events.push_back(event);
+    }
+
+    // Events at the same time keep the order of the file
+    stable_sort(events.begin(), events.end(), [](const TopologyEvent &a, const TopologyEvent &b) { return a.at < b.at; });
+    return true;
+}
+
+#endif
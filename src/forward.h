@@ -0,0 +1,204 @@
+/*
+ *  Queue of the data messages a node forwards, bounded per next hop
+ *  and backed by a pool of reused buffers.
+ *  Copyright (C) 2021 Sourabh J Choure
+ *
+ *  I promise that the work presented below is of my own.
+ *
+ *  To make it FOSS Compliant, this software is free to use.
+ */
+
+#ifndef FORWARD_H
+#define FORWARD_H
+
+// STL
+#include <string>
+#include <vector>
+// SL
+#include <cstring>
+// Counters
+#include "stats.h"
+
+using namespace std;
+
+// Data messages a node holds per next hop before the policy kicks in
+#define FORWARD_LIMIT 64
+
+// What happens to a message that finds its next hop full
+enum QueuePolicy
+{
+    // Drop the message that just came in
+    DROP_TAIL,
+    // Drop the oldest message waiting for the same hop
+    DROP_HEAD,
+    // Keep everything, the node writes the queue out before reading on
+    BACKPRESSURE
+};
+
+// Parse the name of a policy given on the command line
+inline bool parseQueuePolicy(const char *name, QueuePolicy &policy)
+{
+    if (strcmp(name, "tail") == 0)
+        policy = DROP_TAIL;
+    else if (strcmp(name, "head") == 0)
+        policy = DROP_HEAD;
+    else if (strcmp(name, "backpressure") == 0)
+        policy = BACKPRESSURE;
+    else
+        return false;
+
+    return true;
+}
+
+class ForwardQueue
+{
+public:
+    ForwardQueue(size_t numNodes) : hops(numNodes){};
+    ~ForwardQueue();
+
+    // Most messages waiting for a single hop
+    size_t limit = FORWARD_LIMIT;
+
+    // Policy once a hop is full
+    QueuePolicy policy = BACKPRESSURE;
+
+    // Messages dropped by either drop policy
+    Counter droppedTail;
+    Counter droppedHead;
+
+    // Messages waiting for every hop together
+    size_t size() const { return queued; };
+
+    // True when a hop is full and the policy wants the queue written out
+    bool blocked() const { return policy == BACKPRESSURE && fullHops > 0; };
+
+    // True when a message for the hop would be dropped on arrival
+    bool refuses(size_t hop) const { return policy == DROP_TAIL && hops[hop].length() >= limit; };
+
+    // Empty buffer to encode a message into, handed back with push
+    string *acquire();
+
+    // Queue an encoded message for the hop, false if it was dropped
+    bool push(size_t hop, string *message);
+
+    // Hand every message to write, hop by hop in the order they became busy
+    template <class Write>
+    void drain(Write write);
+
+private:
+    // Messages of one hop, the live ones from head to the end
+    struct Hop
+    {
+        vector<string *> messages;
+        size_t head = 0;
+
+        size_t length() const { return messages.size() - head; };
+    };
+
+    vector<Hop> hops;
+
+    // Hops with something queued, so a drain never looks at the idle ones
+    vector<size_t> busy;
+
+    // Buffers ready to be reused
+    vector<string *> pool;
+
+    size_t queued = 0;
+    size_t fullHops = 0;
+
+    // Put a buffer back in the pool, keeping its memory
+    void release(string *message);
+};
+
+inline ForwardQueue::~ForwardQueue()
+{
+    for (size_t i = 0; i < hops.size(); i++)
+        for (size_t j = hops[i].head; j < hops[i].messages.size(); j++)
+            delete hops[i].messages[j];
+
+    for (size_t k = 0; k < pool.size(); k++)
+        delete pool[k];
+}
+
+inline string *ForwardQueue::acquire()
+{
+    if (pool.empty())
+        return new string;
+
+    string *message = pool.back();
+    pool.pop_back();
+    return message;
+}
+
+inline void ForwardQueue::release(string *message)
+{
+    message->clear();
+    pool.push_back(message);
+}
+
+inline bool ForwardQueue::push(size_t hop, string *message)
+{
+    Hop &q = hops[hop];
+
+    // A hop that was idle joins the ones to drain
+    if (q.length() == 0)
+        busy.push_back(hop);
+
+    if (q.length() >= limit)
+    {
+        if (policy == DROP_TAIL)
+        {
+            droppedTail++;
+            release(message);
+            return false;
+        }
+
+        if (policy == DROP_HEAD)
+        {
+            // Make room by giving up the oldest
+            droppedHead++;
+            release(q.messages[q.head]);
+            q.head++;
+            queued--;
+
+            // Keep the dead slots at the front from piling up
+            if (q.head >= limit)
+            {
+                q.messages.erase(q.messages.begin(), q.messages.begin() + q.head);
+                q.head = 0;
+            }
+        }
+    }
+
+    q.messages.push_back(message);
+    queued++;
+
+    if (policy == BACKPRESSURE && q.length() == limit)
+        fullHops++;
+
+    return true;
+}
+
+template <class Write>
+inline void ForwardQueue::drain(Write write)
+{
+    for (size_t k = 0; k < busy.size(); k++)
+    {
+        Hop &q = hops[busy[k]];
+        for (size_t j = q.head; j < q.messages.size(); j++)
+        {
+            write(*q.messages[j]);
+            release(q.messages[j]);
+        }
+
+        // The vector keeps its room for the next burst
+        q.messages.clear();
+        q.head = 0;
+    }
+
+    busy.clear();
+    queued = 0;
+    fullHops = 0;
+}
+
+#endif
@@ -0,0 +1,667 @@
+/*
+ *  Encoders and decoders of the Hello, Intree and Data messages, either
+ *  as readable text lines or as compact binary frames.
+ *  Copyright (C) 2021 Sourabh J Choure
+ *
+ *  I promise that the work presented below is of my own.
+ *
+ *  To make it FOSS Compliant, this software is free to use.
+ */
+
+#ifndef FRAME_H
+#define FRAME_H
+
+// STL
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <utility>
+// SL
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+
+using namespace std;
+
+// Highest cost of a link, so the costs along any path add up within an int
+#define MAX_LINK_COST 65535
+
+enum WireFormat
+{
+    // "Hello 3", one message per line, for debugging
+    TEXT_WIRE,
+    // Length prefixed frames with varint node numbers
+    BINARY_WIRE
+};
+
+// Type tag of a message, also the first byte of a binary frame
+enum MessageType
+{
+    UNKNOWN_MESSAGE = 0,
+    HELLO_MESSAGE = 'H',
+    INTREE_MESSAGE = 'I',
+    DATA_MESSAGE = 'D',
+    // Whole intree with its sequence number, in delta mode
+    SNAPSHOT_MESSAGE = 'S',
+    // Edges added and removed since the previous sequence number
+    DELTA_MESSAGE = 'U',
+    // Ask the root of an intree for a snapshot
+    RESYNC_MESSAGE = 'R'
+};
+
+// A decoded message, reused from one message to the next
+struct Message
+{
+    MessageType type = UNKNOWN_MESSAGE;
+
+    // Sender of a hello, root of an intree or source of a data message
+    size_t src = 0;
+
+    // Destination of a data message, root asked for a snapshot by a resync
+    size_t dest = 0;
+
+    // Sequence number of a snapshot or a delta
+    uint64_t seq = 0;
+
+    // Cost of the link a hello came over
+    uint32_t cost = 1;
+
+    // Edges (child parent) of an intree, or those added by a delta
+    vector<pair<size_t, size_t>> edges;
+
+    // Cost of every edge, empty when they all cost 1
+    vector<uint32_t> costs;
+
+    // Edges removed by a delta
+    vector<pair<size_t, size_t>> removed;
+
+    // Intermediate nodes of a data message
+    vector<size_t> route;
+
+    // Text of a data message, pointing into the decoded buffer
+    const char *text = NULL;
+    size_t textLen = 0;
+};
+
+// Cost of edge i of a decoded message
+inline uint32_t edgeCost(const Message &msg, size_t i)
+{
+    return i < msg.costs.size() ? msg.costs[i] : 1;
+}
+
+// Cost of a link as the topology or a message gives it, within 1 and MAX_LINK_COST
+inline uint32_t clampCost(uint64_t cost)
+{
+    return cost < 1 ? 1 : (cost > MAX_LINK_COST ? MAX_LINK_COST : cost);
+}
+
+// Bytes of a single message inside a buffer owned by someone else
+struct MessageView
+{
+    const char *data = NULL;
+    size_t length = 0;
+};
+
+// Append v in 7 bit groups, lowest first
+inline void putVarint(string &out, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        out += char((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    out += char(v);
+}
+
+// Read a varint and move past it, false if it runs past end
+inline bool getVarint(const char *&p, const char *end, uint64_t &v)
+{
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7)
+    {
+        uint8_t byte = *p++;
+        v |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// Append the decimal form of a node
+inline void putNumber(string &out, size_t v)
+{
+    char digits[20];
+    int len = 0;
+    do
+    {
+        digits[len++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+
+    while (len)
+        out += digits[--len];
+}
+
+// Read a node of the network in decimal and move past it, without going past end
+inline bool getNumber(const char *&p, const char *end, size_t numNodes, size_t &v)
+{
+    // Blanks before the number, but never into the next message
+    const char *q = p;
+    while (q < end && *q == ' ')
+        q++;
+
+    if (q == end || *q < '0' || *q > '9')
+        return false;
+
+    // Reject anything that is not a node of this network
+    size_t node = 0;
+    for (; q < end && *q >= '0' && *q <= '9'; q++)
+    {
+        node = node * 10 + (*q - '0');
+        if (node >= numNodes)
+            return false;
+    }
+
+    p = q;
+    v = node;
+    return true;
+}
+
+inline void encodeHello(WireFormat wire, size_t ID, string &out)
+{
+    out.clear();
+
+    if (wire == BINARY_WIRE)
+    {
+        out += char(HELLO_MESSAGE);
+        putVarint(out, ID);
+        return;
+    }
+
+    out += "Hello ";
+    putNumber(out, ID);
+}
+
+// Check that a message is a hello without decoding it
+inline bool isHello(WireFormat wire, const char *data, size_t length)
+{
+    if (wire == BINARY_WIRE)
+        return length > 0 && data[0] == char(HELLO_MESSAGE);
+
+    return length >= 6 && memcmp(data, "Hello ", 6) == 0;
+}
+
+// Copy a hello with the cost of the link it goes over, "Hello 3 5"
+inline void addLinkCost(WireFormat wire, const char *data, size_t length, uint32_t cost, string &out)
+{
+    out.assign(data, length);
+
+    if (wire == BINARY_WIRE)
+    {
+        putVarint(out, cost);
+        return;
+    }
+
+    out += ' ';
+    putNumber(out, cost);
+}
+
+// Append the edges as "(A D)(C D)", each after the sign when there is one, and with its cost when it is not 1
+inline void putEdges(string &out, const vector<pair<size_t, size_t>> &edges, const vector<uint32_t> *costs, char sign)
+{
+    for (size_t i = 0; i < edges.size(); i++)
+    {
+        if (sign)
+            out += sign;
+        out += '(';
+        putNumber(out, edges[i].first);
+        out += ' ';
+        putNumber(out, edges[i].second);
+        if (costs && (*costs)[i] != 1)
+        {
+            out += ' ';
+            putNumber(out, (*costs)[i]);
+        }
+        out += ')';
+    }
+}
+
+// Append the count and the edges as varints
+inline void putEdgeVarints(string &out, const vector<pair<size_t, size_t>> &edges)
+{
+    putVarint(out, edges.size());
+    for (size_t i = 0; i < edges.size(); i++)
+    {
+        putVarint(out, edges[i].first);
+        putVarint(out, edges[i].second);
+    }
+}
+
+// Append the costs after the edges of a frame, nothing when they all cost 1 so older readers see the same frame
+inline void putCostVarints(string &out, const vector<uint32_t> *costs)
+{
+    if (!costs || count(costs->begin(), costs->end(), 1u) == (ptrdiff_t)costs->size())
+        return;
+
+    putVarint(out, costs->size());
+    for (size_t i = 0; i < costs->size(); i++)
+        putVarint(out, (*costs)[i]);
+}
+
+inline void encodeIntree(WireFormat wire, size_t root, const vector<pair<size_t, size_t>> &edges, string &out, const vector<uint32_t> *costs = NULL)
+{
+    out.clear();
+
+    if (wire == BINARY_WIRE)
+    {
+        out += char(INTREE_MESSAGE);
+        putVarint(out, root);
+        putEdgeVarints(out, edges);
+        putCostVarints(out, costs);
+        return;
+    }
+
+    // "Intree D (A D)(C D 4)", or just "Intree D" without any edge
+    out += "Intree ";
+    putNumber(out, root);
+    if (!edges.empty())
+        out += ' ';
+    putEdges(out, edges, costs, 0);
+}
+
+inline void encodeData(WireFormat wire, size_t src, size_t dest, const size_t *route, size_t routeLen, const char *text, size_t textLen, string &out)
+{
+    out.clear();
+
+    if (wire == BINARY_WIRE)
+    {
+        out += char(DATA_MESSAGE);
+        putVarint(out, src);
+        putVarint(out, dest);
+        putVarint(out, routeLen);
+        for (size_t i = 0; i < routeLen; i++)
+            putVarint(out, route[i]);
+        out.append(text, textLen);
+        return;
+    }
+
+    // "Data src dst i1 i2 .. begin text"
+    out += "Data ";
+    putNumber(out, src);
+    out += ' ';
+    putNumber(out, dest);
+    out += ' ';
+    for (size_t i = 0; i < routeLen; i++)
+    {
+        putNumber(out, route[i]);
+        out += ' ';
+    }
+    out += "begin ";
+    out.append(text, textLen);
+}
+
+// Check that the message at p starts with the keyword, and move past it
+inline bool skipKeyword(const char *&p, const char *end, const char *keyword)
+{
+    size_t len = strlen(keyword);
+    if (size_t(end - p) < len || memcmp(p, keyword, len) != 0)
+        return false;
+
+    p += len;
+    return true;
+}
+
+inline void encodeSnapshot(WireFormat wire, size_t root, uint64_t seq, const vector<pair<size_t, size_t>> &edges, string &out, const vector<uint32_t> *costs = NULL)
+{
+    out.clear();
+
+    if (wire == BINARY_WIRE)
+    {
+        out += char(SNAPSHOT_MESSAGE);
+        putVarint(out, root);
+        putVarint(out, seq);
+        putEdgeVarints(out, edges);
+        putCostVarints(out, costs);
+        return;
+    }
+
+    // "Snapshot D 7 (A D)(C D)"
+    out += "Snapshot ";
+    putNumber(out, root);
+    out += ' ';
+    putNumber(out, seq);
+    if (!edges.empty())
+        out += ' ';
+    putEdges(out, edges, costs, 0);
+}
+
+// Costs go with the added edges only, a removed edge is known by its ends
+inline void encodeDelta(WireFormat wire, size_t root, uint64_t seq, const vector<pair<size_t, size_t>> &added, const vector<pair<size_t, size_t>> &removed, string &out, const vector<uint32_t> *costs = NULL)
+{
+    out.clear();
+
+    if (wire == BINARY_WIRE)
+    {
+        out += char(DELTA_MESSAGE);
+        putVarint(out, root);
+        putVarint(out, seq);
+        putEdgeVarints(out, added);
+        putEdgeVarints(out, removed);
+        putCostVarints(out, costs);
+        return;
+    }
+
+    // "Delta D 8 +(A D)-(C D)", just "Delta D 8" when nothing changed
+    out += "Delta ";
+    putNumber(out, root);
+    out += ' ';
+    putNumber(out, seq);
+    if (!added.empty() || !removed.empty())
+        out += ' ';
+    putEdges(out, added, costs, '+');
+    putEdges(out, removed, NULL, '-');
+}
+
+inline void encodeResync(WireFormat wire, size_t from, size_t root, string &out)
+{
+    out.clear();
+
+    if (wire == BINARY_WIRE)
+    {
+        out += char(RESYNC_MESSAGE);
+        putVarint(out, from);
+        putVarint(out, root);
+        return;
+    }
+
+    // "Resync R D", R wants a snapshot of D
+    out += "Resync ";
+    putNumber(out, from);
+    out += ' ';
+    putNumber(out, root);
+}
+
+// Read a sequence number or a cost in decimal and move past it
+inline bool getDecimal(const char *&p, const char *end, uint64_t &v)
+{
+    const char *q = p;
+    while (q < end && *q == ' ')
+        q++;
+
+    if (q == end || *q < '0' || *q > '9')
+        return false;
+
+    for (v = 0; q < end && *q >= '0' && *q <= '9'; q++)
+        v = v * 10 + (*q - '0');
+
+    p = q;
+    return true;
+}
+
+// Read the edges "(A D)" or "(A D 4)" up to end, those after a '-' into removed when there is such a list
+inline void getTextEdges(const char *p, const char *end, size_t numNodes, Message &msg, bool delta)
+{
+    while ((p = (const char *)memchr(p, '(', end - p)) != NULL)
+    {
+        bool removed = (delta && p[-1] == '-');
+        p++;
+        size_t child, parent;
+        if (!getNumber(p, end, numNodes, child) || !getNumber(p, end, numNodes, parent))
+            continue;
+
+        if (removed)
+        {
+            msg.removed.push_back(make_pair(child, parent));
+            continue;
+        }
+
+        uint64_t cost;
+        msg.edges.push_back(make_pair(child, parent));
+        msg.costs.push_back(getDecimal(p, end, cost) ? clampCost(cost) : 1);
+    }
+}
+
+// Read the costs that may follow the edges of a frame, they only count if there is one for every edge
+inline void getCostVarints(const char *p, const char *end, Message &msg)
+{
+    uint64_t count, cost;
+    if (p == end || !getVarint(p, end, count) || count != msg.edges.size())
+        return;
+
+    for (uint64_t i = 0; i < count; i++)
+    {
+        if (!getVarint(p, end, cost))
+        {
+            msg.costs.clear();
+            return;
+        }
+        msg.costs.push_back(clampCost(cost));
+    }
+}
+
+// Drop the edges with a node out of range along with their costs, once the costs were matched to the edges on the wire
+inline void keepEdgesInRange(Message &msg, size_t numNodes)
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < msg.edges.size(); i++)
+    {
+        if (msg.edges[i].first >= numNodes || msg.edges[i].second >= numNodes)
+            continue;
+
+        msg.edges[kept] = msg.edges[i];
+        if (!msg.costs.empty())
+            msg.costs[kept] = msg.costs[i];
+        kept++;
+    }
+
+    msg.edges.resize(kept);
+    if (!msg.costs.empty())
+        msg.costs.resize(kept);
+}
+
+inline bool decodeText(const char *p, const char *end, size_t numNodes, Message &msg)
+{
+    if (skipKeyword(p, end, "Hello "))
+    {
+        msg.type = HELLO_MESSAGE;
+        if (!getNumber(p, end, numNodes, msg.src))
+            return false;
+
+        // The controller adds the cost of the link when it is not 1
+        uint64_t cost;
+        msg.cost = getDecimal(p, end, cost) ? clampCost(cost) : 1;
+        return true;
+    }
+
+    if (skipKeyword(p, end, "Intree "))
+    {
+        msg.type = INTREE_MESSAGE;
+        msg.edges.clear();
+        msg.costs.clear();
+        if (!getNumber(p, end, numNodes, msg.src))
+            return false;
+
+        // Every edge is "(A D)", with its cost when it is not 1
+        getTextEdges(p, end, numNodes, msg, false);
+        return true;
+    }
+
+    bool snapshot = skipKeyword(p, end, "Snapshot ");
+    if (snapshot || skipKeyword(p, end, "Delta "))
+    {
+        msg.type = snapshot ? SNAPSHOT_MESSAGE : DELTA_MESSAGE;
+        msg.edges.clear();
+        msg.removed.clear();
+        msg.costs.clear();
+        if (!getNumber(p, end, numNodes, msg.src) || !getDecimal(p, end, msg.seq))
+            return false;
+
+        // Every edge is "(A D)", after a '-' when a delta removes it
+        getTextEdges(p, end, numNodes, msg, msg.type == DELTA_MESSAGE);
+        return true;
+    }
+
+    if (skipKeyword(p, end, "Resync "))
+    {
+        msg.type = RESYNC_MESSAGE;
+        return getNumber(p, end, numNodes, msg.src) && getNumber(p, end, numNodes, msg.dest);
+    }
+
+    if (skipKeyword(p, end, "Data "))
+    {
+        msg.type = DATA_MESSAGE;
+        msg.route.clear();
+        if (!getNumber(p, end, numNodes, msg.src) || !getNumber(p, end, numNodes, msg.dest))
+            return false;
+
+        // Intermediate nodes up to "begin"
+        size_t node;
+        while (getNumber(p, end, numNodes, node))
+            msg.route.push_back(node);
+
+        if (end - p < 6 || memcmp(p, " begin", 6) != 0)
+            return false;
+
+        // The text follows "begin "
+        p += (end - p > 6) ? 7 : 6;
+        msg.text = p;
+        msg.textLen = end - p;
+        return true;
+    }
+
+    msg.type = UNKNOWN_MESSAGE;
+    return false;
+}
+
+inline bool decodeBinary(const char *p, const char *end, size_t numNodes, Message &msg)
+{
+    uint64_t v, w, count;
+
+    if (p == end)
+        return false;
+
+    msg.type = MessageType(*p++);
+    switch (msg.type)
+    {
+    case HELLO_MESSAGE:
+        if (!getVarint(p, end, v) || v >= numNodes)
+            return false;
+        msg.src = v;
+
+        // The controller adds the cost of the link when it is not 1
+        msg.cost = (p < end && getVarint(p, end, w)) ? clampCost(w) : 1;
+        return true;
+
+    case INTREE_MESSAGE:
+        msg.edges.clear();
+        msg.costs.clear();
+        if (!getVarint(p, end, v) || v >= numNodes || !getVarint(p, end, count))
+            return false;
+        msg.src = v;
+
+        for (uint64_t i = 0; i < count; i++)
+        {
+            if (!getVarint(p, end, v) || !getVarint(p, end, w))
+                return false;
+            msg.edges.push_back(make_pair(v, w));
+        }
+        getCostVarints(p, end, msg);
+        keepEdgesInRange(msg, numNodes);
+        return true;
+
+    case SNAPSHOT_MESSAGE:
+    case DELTA_MESSAGE:
+        msg.edges.clear();
+        msg.removed.clear();
+        msg.costs.clear();
+        if (!getVarint(p, end, v) || v >= numNodes || !getVarint(p, end, msg.seq))
+            return false;
+        msg.src = v;
+
+        // The edges of a snapshot, or those added by a delta and then those removed
+        for (int list = 0; list < (msg.type == DELTA_MESSAGE ? 2 : 1); list++)
+        {
+            if (!getVarint(p, end, count))
+                return false;
+
+            for (uint64_t i = 0; i < count; i++)
+            {
+                if (!getVarint(p, end, v) || !getVarint(p, end, w))
+                    return false;
+
+                // The costs belong to the added edges, which are checked once they are matched
+                if (list == 0)
+                    msg.edges.push_back(make_pair(v, w));
+                else if (v < numNodes && w < numNodes)
+                    msg.removed.push_back(make_pair(v, w));
+            }
+        }
+        getCostVarints(p, end, msg);
+        keepEdgesInRange(msg, numNodes);
+        return true;
+
+    case RESYNC_MESSAGE:
+        if (!getVarint(p, end, v) || v >= numNodes || !getVarint(p, end, w) || w >= numNodes)
+            return false;
+        msg.src = v;
+        msg.dest = w;
+        return true;
+
+    case DATA_MESSAGE:
+        msg.route.clear();
+        if (!getVarint(p, end, v) || v >= numNodes)
+            return false;
+        msg.src = v;
+        if (!getVarint(p, end, v) || v >= numNodes || !getVarint(p, end, count))
+            return false;
+        msg.dest = v;
+
+        for (uint64_t i = 0; i < count; i++)
+        {
+            if (!getVarint(p, end, v) || v >= numNodes)
+                return false;
+            msg.route.push_back(v);
+        }
+
+        // The text is the rest of the frame
+        msg.text = p;
+        msg.textLen = end - p;
+        return true;
+
+    default:
+        msg.type = UNKNOWN_MESSAGE;
+        return false;
+    }
+}
+
+// Decode a message of either format in place, false if it is malformed
+inline bool decodeMessage(WireFormat wire, const MessageView &in, size_t numNodes, Message &msg)
+{
+    if (wire == BINARY_WIRE)
+        return decodeBinary(in.data, in.data + in.length, numNodes, msg);
+
+    return decodeText(in.data, in.data + in.length, numNodes, msg);
+}
+
+inline bool decodeMessage(WireFormat wire, const string &in, size_t numNodes, Message &msg)
+{
+    MessageView view;
+    view.data = in.data();
+    view.length = in.length();
+    return decodeMessage(wire, view, numNodes, msg);
+}
+
+// Parse the name of a wire format given on the command line
+inline bool parseWire(const char *name, WireFormat &wire)
+{
+    if (strcmp(name, "text") == 0)
+        wire = TEXT_WIRE;
+    else if (strcmp(name, "binary") == 0)
+        wire = BINARY_WIRE;
+    else
+        return false;
+
+    return true;
+}
+
+#endif
@@ -0,0 +1,297 @@
+/*
+ *  Emulation of the links of the topology in the controller, with a
+ *  propagation delay, a bandwidth, a queue and a loss rate per link.
+ *  Copyright (C) 2021 Sourabh J Choure
+ *
+ *  I promise that the work presented below is of my own.
+ *
+ *  To make it FOSS Compliant, this software is free to use.
+ */
+
+#ifndef LINK_H
+#define LINK_H
+
+// STL
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+// SL
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+// Timers of the messages on the way
+#include "wheel.h"
+
+using namespace std;
+
+// Microseconds in a tick of the timing wheel of the links
+#define LINK_TICK_US 100
+
+// Longest propagation delay a link may have, in milliseconds
+#define MAX_LINK_DELAY_MS 3600000
+
+// Seed of the losses, fixed so that runs repeat
+#define LINK_SEED 6390
+
+// No message, or no copy of it yet
+#define LINK_NONE 0xffffffffu
+
+// What a link does, nothing unless it is given something
+struct LinkModel
+{
+    // Propagation delay in microseconds
+    uint64_t delayUs = 0;
+
+    // Kilobits per second a message is sent at, 0 for no limit
+    uint64_t bandwidth = 0;
+
+    // Messages waiting to be sent or being sent, 0 for no limit
+    size_t queue = 0;
+
+    // Chance that a message is lost, from 0 to 1
+    double loss = 0;
+
+    // True if messages do not just go through
+    bool emulated() const { return delayUs || bandwidth || loss > 0; };
+};
+
+// Take one "delay=MS", "bw=KBPS", "queue=N" or "loss=P" setting
+inline bool parseLinkSetting(const string &setting, LinkModel &model)
+{
+    size_t equals = setting.find('=');
+    if (equals == string::npos || equals + 1 == setting.length())
+        return false;
+
+    string key = setting.substr(0, equals);
+    const char *value = setting.c_str() + equals + 1;
+    char *end;
+
+    if (key == "delay")
+    {
+        double ms = strtod(value, &end);
+        if (*end != '\0' || ms < 0 || ms > MAX_LINK_DELAY_MS)
+            return false;
+        model.delayUs = ms * 1000;
+    }
+    else if (key == "bw")
+    {
+        long kbps = strtol(value, &end, 10);
+        if (*end != '\0' || kbps < 0)
+            return false;
+        model.bandwidth = kbps;
+    }
+    else if (key == "queue")
+    {
+        long count = strtol(value, &end, 10);
+        if (*end != '\0' || count < 0)
+            return false;
+        model.queue = count;
+    }
+    else if (key == "loss")
+    {
+        double chance = strtod(value, &end);
+        if (*end != '\0' || chance < 0 || chance > 1)
+            return false;
+        model.loss = chance;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+// Take the settings of a link, separated by commas
+inline bool parseLinkModel(const char *text, LinkModel &model)
+{
+    string settings(text);
+    size_t start = 0;
+    while (start <= settings.length())
+    {
+        size_t comma = min(settings.find(',', start), settings.length());
+        if (!parseLinkSetting(settings.substr(start, comma - start), model))
+            return false;
+        start = comma + 1;
+    }
+
+    return true;
+}
+
+// What became of a message sent over a link
+enum LinkVerdict
+{
+    // It is on the way
+    LINK_PASSED,
+    // It took the link but never arrives
+    LINK_LOST,
+    // The queue of the link was full
+    LINK_FULL
+};
+
+// A link of the topology and the messages it is sending
+struct LinkState
+{
+    LinkState(){};
+    LinkState(const LinkModel &model) : model(model){};
+
+    LinkModel model;
+
+    // Time the last message in the queue is sent, in microseconds
+    uint64_t busyUntil = 0;
+
+    // Times the messages in the queue are sent, from the first one, kept with a queue limit only
+    vector<uint64_t> departures;
+    size_t first = 0;
+};
+
+// Messages on the way over the emulated links, each waiting in a timing wheel until it arrives
+class LinkEmulator
+{
+public:
+    LinkEmulator() : wheel(LINK_TICK_US), random(LINK_SEED){};
+
+    // Send a message of that many bytes over the link, and tell when it arrives
+    LinkVerdict send(LinkState &, size_t, uint64_t, uint64_t &);
+
+    // Keep a copy of a message for the links it goes over
+    uint32_t share(const char *, size_t);
+
+    // Hold a copy for the destination until it arrives
+    void hold(size_t, uint32_t, uint64_t, uint64_t);
+
+    // Give every message that arrived by now to write(dest, message), in order, and return how many
+    template <class Write>
+    size_t deliver(uint64_t, Write);
+
+    // Earliest time a message may arrive, false if none is on the way
+    bool nextDue(uint64_t &at) const { return wheel.nextDue(at); };
+
+    // Messages on the way
+    size_t size() const { return wheel.size(); };
+
+private:
+    // Arrival times of the messages on the way
+    TimingWheel wheel;
+
+    // Draws of the losses
+    mt19937 random;
+
+    // Destination and copy of every message on the way, recycled through a free list
+    struct Held
+    {
+        size_t dest;
+        uint32_t payload;
+    };
+    vector<Held> held;
+    vector<uint32_t> freeHeld;
+
+    // Copies of the messages, with the number of links still holding them
+    vector<string> payloads;
+    vector<uint32_t> refs;
+    vector<uint32_t> freePayloads;
+};
+
+inline LinkVerdict LinkEmulator::send(LinkState &link, size_t bytes, uint64_t now, uint64_t &arrival)
+{
+    const LinkModel &model = link.model;
+    uint64_t departure = now;
+
+    if (model.bandwidth)
+    {
+        // Messages already sent are out of the queue
+        if (model.queue)
+        {
+            while (link.first < link.departures.size() && link.departures[link.first] <= now)
+                link.first++;
+            if (link.first == link.departures.size())
+            {
+                link.departures.clear();
+                link.first = 0;
+            }
+            else if (link.first * 2 > link.departures.size())
+            {
+                link.departures.erase(link.departures.begin(), link.departures.begin() + link.first);
+                link.first = 0;
+            }
+
+            if (link.departures.size() - link.first >= model.queue)
+                return LINK_FULL;
+        }
+
+        // Sent once everything before it was, at the speed of the link
+        departure = max(now, link.busyUntil) + (bytes * 8000 + model.bandwidth - 1) / model.bandwidth;
+        link.busyUntil = departure;
+        if (model.queue)
+            link.departures.push_back(departure);
+    }
+
+    // A lost message still took its time on the link
+    if (model.loss > 0 && random() < model.loss * 4294967296.0)
+        return LINK_LOST;
+
+    arrival = departure + model.delayUs;
+    return LINK_PASSED;
+}
+
+inline uint32_t LinkEmulator::share(const char *data, size_t len)
+{
+    uint32_t payload;
+    if (freePayloads.empty())
+    {
+        payload = payloads.size();
+        payloads.push_back(string());
+        refs.push_back(0);
+    }
+    else
+    {
+        payload = freePayloads.back();
+        freePayloads.pop_back();
+    }
+
+    payloads[payload].assign(data, len);
+    return payload;
+}
+
+inline void LinkEmulator::hold(size_t dest, uint32_t payload, uint64_t arrival, uint64_t now)
+{
+    uint32_t id;
+    if (freeHeld.empty())
+    {
+        id = held.size();
+        held.push_back(Held());
+    }
+    else
+    {
+        id = freeHeld.back();
+        freeHeld.pop_back();
+    }
+
+    held[id].dest = dest;
+    held[id].payload = payload;
+    refs[payload]++;
+
+    wheel.schedule(id, arrival, now);
+}
+
+template <class Write>
+inline size_t LinkEmulator::deliver(uint64_t now, Write write)
+{
+    size_t count = 0;
+
+    wheel.advance(now, [&](uint32_t id) {
+        uint32_t payload = held[id].payload;
+        write(held[id].dest, payloads[payload]);
+        count++;
+
+        // The last link to deliver the copy gives it back
+        if (--refs[payload] == 0)
+            freePayloads.push_back(payload);
+        freeHeld.push_back(id);
+    });
+
+    return count;
+}
+
+#endif
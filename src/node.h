@@ -0,0 +1,2828 @@
+/*
+ *  A node of the network with capabilities to send and receive
+ *  data packets via channels, and to route them with in-trees.
+ *  Copyright (C) 2021 Sourabh J Choure
+ *
+ *  I promise that the work presented below is of my own.
+ *
+ *  To make it FOSS Compliant, this software is free to use.
+ */
+
+#ifndef NODE_H
+#define NODE_H
+
+// STL
+#include <iostream>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+// SL
+#include <cstdlib>
+#include <cstring>
+// Unix
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/timerfd.h>
+// Channels
+#include "channel.h"
+// Counters
+#include "stats.h"
+// Forwarding queue
+#include "forward.h"
+// Scratch memory
+#include "arena.h"
+// Generated traffic
+#include "traffic.h"
+
+using namespace std;
+
+// Number of nodes unless given on the command line
+#define NUMNODES 10
+
+// Periods of the protocols in seconds
+#define HELLO_PERIOD 30
+#define INTREE_PERIOD 10
+#define DATA_PERIOD 15
+
+// Dead neighbors are checked every INTREE_PERIOD, this much after the intree
+#define CHECK_OFFSET 2
+
+// Intree periods between two snapshots in delta mode
+#define SNAPSHOT_PERIODS 6
+
+// Keepalives a neighbor may miss in a row before it is dead, with --keepalive-ms
+#define MISSED_LIMIT 3
+
+// Milliseconds a neighbor stays out after its second death in a row, doubled for every further one
+#define HOLD_DOWN_MS 1000
+
+// Doublings of the hold-down at most
+#define HOLD_DOWN_DOUBLINGS 6
+
+// Milliseconds a neighbor has to stay up for one of its deaths to be forgiven
+#define FLAP_DECAY_MS 30000
+
+// Milliseconds between two looks at the shared memory ring while messages come in,
+// doubled every time it was empty up to the longest wait
+#define RING_POLL_MS 1
+#define RING_MAX_POLL_MS 16
+
+struct Queue
+{
+    // Constructor of the Queue
+    Queue(int cap) : cap(cap), p(new int[cap]), f(0), r(0), n(0), owned(true){};
+
+    // Same, with the array taken from the scratch memory
+    Queue(int cap, Arena &arena) : cap(cap), p(arena.take<int>(cap)), f(0), r(0), n(0), owned(false){};
+
+    ~Queue()
+    {
+        if (owned)
+            delete[] p;
+    };
+
+    // Store the total capacity of the Queue
+    int cap;
+
+    // Pointer to array
+    int *p;
+
+    // Index to the front of the Queue
+    int f;
+
+    // Index to the rear of the Queue
+    int r;
+
+    // Total Number of elements in the Queue
+    int n;
+
+    // Check if the array is ours to delete
+    bool owned;
+
+    // Put the elements in the Queue
+    void enqueue(int);
+
+    // Remove the elements from the Queue
+    int dequeue();
+
+    // Check if the Queue is empty
+    bool empty();
+};
+
+inline void Queue::enqueue(int val)
+{
+    if (n == cap)
+    {
+        // Queue is Full
+    }
+
+    // Put the val
+    p[r] = val;
+
+    // Increment the rear index
+    r = (r + 1) % cap;
+
+    // Increment the total number of elements
+    n++;
+}
+
+inline int Queue::dequeue()
+{
+    if (n == 0)
+    {
+        // Queue is Empty
+    }
+
+    // Remove the element
+    int tmp = p[f];
+
+    // Increment the front index
+    f = (f + 1) % cap;
+
+    // Decrement the number of elements
+    n--;
+
+    // Return the element
+    return tmp;
+}
+
+inline bool Queue::empty()
+{
+    return (n == 0) ? true : false;
+}
+
+// Binary heap of nodes by their cost, which can lower the cost of a node already in it
+struct CostHeap
+{
+    // Arrays taken from the scratch memory, the costs are owned by the caller
+    CostHeap(size_t numNodes, const uint64_t *cost, Arena &arena) : cost(cost), heap(arena.take<size_t>(numNodes)), place(arena.take<int>(numNodes, -1)), n(0){};
+
+    // Cost of every node
+    const uint64_t *cost;
+
+    // Nodes in heap order
+    size_t *heap;
+
+    // Index of every node in the heap, -1 if it is not in it
+    int *place;
+
+    // Total Number of nodes in the heap
+    size_t n;
+
+    // Put the node in the heap, or move it up after its cost went down
+    void push(size_t);
+
+    // Remove the node with the lowest cost
+    size_t pop();
+
+    // Check if the heap is empty
+    bool empty() { return n == 0; };
+
+    // Move the node at index i up or down until the heap is in order
+    void siftUp(size_t);
+    void siftDown(size_t);
+};
+
+inline void CostHeap::push(size_t v)
+{
+    if (place[v] == -1)
+    {
+        place[v] = n;
+        heap[n++] = v;
+    }
+
+    siftUp(place[v]);
+}
+
+inline size_t CostHeap::pop()
+{
+    size_t top = heap[0];
+    place[top] = -1;
+
+    // The last node fills the hole and goes down
+    if (--n)
+    {
+        heap[0] = heap[n];
+        place[heap[0]] = 0;
+        siftDown(0);
+    }
+
+    return top;
+}
+
+inline void CostHeap::siftUp(size_t i)
+{
+    size_t v = heap[i];
+    while (i > 0 && cost[heap[(i - 1) / 2]] > cost[v])
+    {
+        heap[i] = heap[(i - 1) / 2];
+        place[heap[i]] = i;
+        i = (i - 1) / 2;
+    }
+
+    heap[i] = v;
+    place[v] = i;
+}
+
+inline void CostHeap::siftDown(size_t i)
+{
+    size_t v = heap[i];
+    while (2 * i + 1 < n)
+    {
+        // The cheaper child
+        size_t c = 2 * i + 1;
+        if (c + 1 < n && cost[heap[c + 1]] < cost[heap[c]])
+            c++;
+        if (cost[heap[c]] >= cost[v])
+            break;
+
+        heap[i] = heap[c];
+        place[heap[i]] = i;
+        i = c;
+    }
+
+    heap[i] = v;
+    place[v] = i;
+}
+
+struct nodeLevel
+{
+    int level = -1;
+    int dest;
+};
+
+// Intree as the parent of every node, with the children of every node linked in increasing order
+struct ParentTree
+{
+    ParentTree(size_t n) : n(n), parent(n, -1), firstChild(n, -1), lastChild(n, -1), nextSibling(n, -1), prevSibling(n, -1){};
+
+    // Number of nodes
+    size_t n;
+
+    // The edge out of every node goes to its parent, -1 if there is none
+    vector<int> parent;
+
+    // First and last child of every node, -1 if there is none
+    vector<int> firstChild;
+    vector<int> lastChild;
+
+    // Children of the same parent before and after every node, -1 at the ends
+    vector<int> nextSibling;
+    vector<int> prevSibling;
+
+    // Check for the edge r -> c
+    bool test(size_t r, size_t c) const { return parent[r] == (int)c; };
+
+    // Place the edge r -> c, instead of the edge out of r
+    void set(size_t, size_t);
+
+    // Remove the edge r -> c
+    void reset(size_t r, size_t c)
+    {
+        if (parent[r] == (int)c)
+            unlink(r);
+    };
+
+    // Remove the edge going out of r
+    void clearRow(size_t r)
+    {
+        if (parent[r] != -1)
+            unlink(r);
+    };
+
+    // Remove every edge
+    void clear();
+
+    // Remove every edge below r, r keeps its own
+    void removeSubtree(size_t);
+
+    // Nodes from v up to the first one without a parent, v first
+    void pathUp(size_t, vector<size_t> &) const;
+
+    bool operator==(const ParentTree &g) const { return n == g.n && parent == g.parent; };
+    bool operator!=(const ParentTree &g) const { return !(*this == g); };
+
+private:
+    // Take r out of the children of its parent
+    void unlink(size_t);
+};
+
+inline void ParentTree::set(size_t r, size_t c)
+{
+    if (parent[r] == (int)c)
+        return;
+    if (parent[r] != -1)
+        unlink(r);
+    parent[r] = c;
+
+    // The children stay in order, and they mostly come in order, so look from the last one
+    int before = lastChild[c];
+    while (before != -1 && before > (int)r)
+        before = prevSibling[before];
+
+    int after = (before == -1) ? firstChild[c] : nextSibling[before];
+    prevSibling[r] = before;
+    nextSibling[r] = after;
+
+    if (before == -1)
+        firstChild[c] = r;
+    else
+        nextSibling[before] = r;
+
+    if (after == -1)
+        lastChild[c] = r;
+    else
+        prevSibling[after] = r;
+}
+
+inline void ParentTree::unlink(size_t r)
+{
+    size_t c = parent[r];
+    int before = prevSibling[r];
+    int after = nextSibling[r];
+
+    if (before == -1)
+        firstChild[c] = after;
+    else
+        nextSibling[before] = after;
+
+    if (after == -1)
+        lastChild[c] = before;
+    else
+        prevSibling[after] = before;
+
+    parent[r] = -1;
+    prevSibling[r] = -1;
+    nextSibling[r] = -1;
+}
+
+inline void ParentTree::clear()
+{
+    fill(parent.begin(), parent.end(), -1);
+    fill(firstChild.begin(), firstChild.end(), -1);
+    fill(lastChild.begin(), lastChild.end(), -1);
+    fill(nextSibling.begin(), nextSibling.end(), -1);
+    fill(prevSibling.begin(), prevSibling.end(), -1);
+}
+
+inline void ParentTree::removeSubtree(size_t r)
+{
+    // r keeps its own edge, which the walk must not come back through in a loop
+    int top = parent[r];
+    clearRow(r);
+
+    // Go down the first children and cut every leaf on the way back up, each node once
+    size_t v = r;
+    while (true)
+    {
+        if (firstChild[v] != -1)
+        {
+            v = firstChild[v];
+            continue;
+        }
+
+        if (v == r)
+            break;
+
+        size_t up = parent[v];
+        unlink(v);
+        v = up;
+    }
+
+    if (top != -1)
+        set(r, top);
+}
+
+inline void ParentTree::pathUp(size_t v, vector<size_t> &path) const
+{
+    path.push_back(v);
+
+    // A tree gets to the top in fewer than n steps, a loop would not
+    for (size_t steps = 0; parent[v] != -1 && steps < n; steps++)
+    {
+        v = parent[v];
+        path.push_back(v);
+    }
+}
+
+// Mark w as visited, and tell if it was not already
+inline bool claimNode(uint64_t *visited, size_t w)
+{
+    uint64_t bit = 1ULL << (w % 64);
+    if (visited[w / 64] & bit)
+        return false;
+
+    visited[w / 64] |= bit;
+    return true;
+}
+
+// Bitmap of visited nodes with only the root in it, in the scratch memory
+inline uint64_t *visitedFrom(const ParentTree &g, size_t root, Arena &arena)
+{
+    uint64_t *visited = arena.take<uint64_t>((g.n + 63) / 64, 0);
+    visited[root / 64] |= 1ULL << (root % 64);
+    return visited;
+}
+
+// Hops from every node to the root along parent, -1 where a node never gets there, cutting parent there too
+// With cost, the cost of the edge out of every node counts instead of a hop
+inline void hopsToRoot(size_t root, int *parent, int *depth, size_t numNodes, Arena &arena, const uint32_t *cost = NULL)
+{
+    ArenaScope scope(arena);
+    char *state = arena.take<char>(numNodes, 0);
+    fill_n(depth, numNodes, -1);
+    depth[root] = 0;
+    state[root] = 2;
+
+    // Nodes walked up from v, every node at most once
+    size_t *chain = arena.take<size_t>(numNodes);
+    size_t chainLen = 0;
+    for (size_t v = 0; v < numNodes; v++)
+    {
+        // Walk up until a node with a known depth, a missing parent or a loop
+        int u = v;
+        while (u != -1 && state[u] == 0)
+        {
+            state[u] = 1;
+            chain[chainLen++] = u;
+            u = parent[u];
+        }
+
+        int hops = (u == -1 || state[u] == 1) ? -1 : depth[u];
+
+        // Every node on the way is one hop further
+        while (chainLen)
+        {
+            size_t w = chain[--chainLen];
+
+            hops = (hops == -1) ? -1 : hops + (cost ? cost[w] : 1);
+            depth[w] = hops;
+            state[w] = 2;
+
+            if (hops == -1)
+                parent[w] = -1;
+        }
+    }
+}
+
+// How a received intree is merged into the own intree
+enum SptMode
+{
+    // Rebuild the whole tree with buildSPT
+    FULL_SPT,
+    // Fix only the nodes the neighbor moved with updateSPT
+    INCREMENTAL_SPT,
+    // Cheapest paths over the link costs with weightedSPT
+    WEIGHTED_SPT
+};
+
+// Name of a merge strategy, as given on the command line
+inline const char *sptName(SptMode mode)
+{
+    return mode == FULL_SPT ? "full" : (mode == INCREMENTAL_SPT ? "incremental" : "weighted");
+}
+
+// An edge of the intree that appeared or disappeared
+struct EdgeChange
+{
+    size_t from;
+    size_t to;
+    bool added;
+};
+
+struct Routing
+{
+    Routing(size_t numNodes, int dest, string dataMessage) : numNodes(numNodes), dest(dest), dataMessage(dataMessage),
+                                                             forward(numNodes), incomingNeighbors(numNodes, 0),
+                                                             intree(numNodes), prevIntree(numNodes), mergeTree(numNodes), pathToIncomingNeighbors(numNodes),
+                                                             parent(numNodes, -1), neighborParent(numNodes), neighborDepth(numNodes),
+                                                             linkCost(numNodes, 1), neighborCost(numNodes), parentCost(numNodes, 1){};
+
+    // Total number of nodes in the network
+    size_t numNodes;
+
+    // Destination Node
+    int dest;
+
+    // Buffer for the data to be sent
+    string dataMessage;
+
+    // Data messages waiting to be passed to the neighbors, per next hop
+    ForwardQueue forward;
+
+    // Keep track of Incoming Neighbors
+    vector<int> incomingNeighbors;
+
+    // In-tree of a Node
+    ParentTree intree;
+
+    // Previous In-tree of a Node
+    ParentTree prevIntree;
+
+    // In-tree being built by buildSPT, kept to reuse its memory
+    ParentTree mergeTree;
+
+    // Check if the Intree changed
+    bool sendIntreeNow = false;
+
+    // Store the path to the neighbor, starting at this node
+    vector<vector<size_t>> pathToIncomingNeighbors;
+
+    // Merge strategy of the received intrees
+    SptMode sptMode = FULL_SPT;
+
+    // Edges that changed in the last merge
+    vector<EdgeChange> changedEdges;
+
+    // Parent of every node in the own intree, -1 if absent (incremental only)
+    vector<int> parent;
+
+    // Parent and hops to this node through every incoming neighbor's intree (incremental only)
+    vector<vector<int>> neighborParent;
+    vector<vector<int>> neighborDepth;
+
+    // Incoming neighbors with an intree on record (incremental and weighted only)
+    vector<size_t> treeNeighbors;
+
+    // Cost of the link from every incoming neighbor, as its hellos tell
+    vector<uint32_t> linkCost;
+
+    // Cost of the edge out of every node in every incoming neighbor's intree (weighted only)
+    vector<vector<uint32_t>> neighborCost;
+
+    // Cost of the edge out of every node in the own intree (weighted only)
+    vector<uint32_t> parentCost;
+
+    // Calls of the extendedBFSt and extendedBFSi traversals
+    Counter bfsTreeCalls;
+    Counter bfsIntreeCalls;
+
+    // Scratch memory of the traversals and merges, reset after every event
+    Arena scratch;
+
+    // Check if incoming Neighbors is empty
+    bool isINempty();
+
+    // Find the path to the Incoming Neighbor
+    void storePathToIncomingNeighbor(size_t, size_t, ParentTree &);
+
+    // buildSPT
+    void buildSPT(size_t, size_t, ParentTree &);
+
+    // Incremental buildSPT from the edges of the neighbor's intree
+    void updateSPT(size_t, size_t, const vector<pair<size_t, size_t>> &);
+
+    // Forget the intree of a dead neighbor (incremental only)
+    void dropNeighborTree(size_t, size_t);
+
+    // Replace the intree of a neighbor and fix the nodes that moved in it
+    void replaceNeighborTree(size_t, size_t, int *);
+
+    // Weighted buildSPT from the edges of the neighbor's intree and their costs
+    void weightedSPT(size_t, size_t, const vector<pair<size_t, size_t>> &, const vector<uint32_t> &);
+
+    // Forget the intree of a dead neighbor (weighted only)
+    void dropWeightedTree(size_t, size_t);
+
+    // Record the cost of the link from a neighbor, true if the intree had to be built again
+    bool setLinkCost(size_t, size_t, uint32_t);
+
+    // Cheapest intree over the intrees of every neighbor, with a binary heap
+    void dijkstraSPT(size_t);
+
+    // Record the difference between prevIntree and intree
+    void diffIntree();
+
+    // Common Function
+    void extendedBFSt(size_t, size_t, ParentTree &, void (Routing::*func)(size_t, size_t, ParentTree &));
+
+    void extendedBFSt(size_t, size_t, ParentTree &, nodeLevel *, void (Routing::*func)(size_t, size_t, ParentTree &, nodeLevel *));
+
+    // Common Function
+    void extendedBFSi(size_t, size_t, ParentTree &, void (Routing::*func)(size_t, size_t, ParentTree &));
+
+    void extendedBFSi(size_t, size_t, ParentTree &, nodeLevel *, void (Routing::*func)(size_t, size_t, ParentTree &, nodeLevel *));
+
+    // Common Function Helper: Remove TmpTree
+    void removeTmpTreePath(size_t, size_t, ParentTree &);
+
+    // Common Function Helper: pruneNode
+    void pruneNode(size_t, size_t, ParentTree &);
+
+    // Common Function Helper: add levels
+    void addLevel(size_t, size_t, ParentTree &, nodeLevel *);
+
+    // Common Function Helper: remove levels
+    void removeLevel(size_t, size_t, ParentTree &, nodeLevel *);
+};
+
+inline bool Routing::isINempty()
+{
+    for (size_t i = 0; i < numNodes; i++)
+    {
+        if (incomingNeighbors[i])
+            return false;
+    }
+
+    return true;
+}
+
+inline void Routing::storePathToIncomingNeighbor(size_t v, size_t rootedAt, ParentTree &tempIntree)
+{
+    // Node v and its parents up to the neighbor, one step per hop
+    tempIntree.pathUp(v, pathToIncomingNeighbors[rootedAt]);
+}
+
+inline void Routing::removeTmpTreePath(size_t w, size_t v, ParentTree &tmpIntree)
+{
+    tmpIntree.reset(w, v);
+}
+
+inline void Routing::pruneNode(size_t w, size_t v, ParentTree &tmpIntree)
+{
+    if (!tmpIntree.test(w, v))
+    {
+        intree.reset(w, v);
+    }
+}
+
+inline void Routing::addLevel(size_t w, size_t v, ParentTree &tmpIntree, nodeLevel *levels)
+{
+    levels[w].level = levels[v].level + 1;
+    levels[w].dest = v;
+}
+
+inline void Routing::removeLevel(size_t w, size_t v, ParentTree &tmpIntree, nodeLevel *levels)
+{
+    tmpIntree.reset(w, v);
+    levels[w].level = -1;
+    levels[w].dest = -1;
+}
+
+inline void Routing::extendedBFSt(size_t ID, size_t rootedAt, ParentTree &tmpIntree, void (Routing::*func)(size_t, size_t, ParentTree &))
+{
+    bfsTreeCalls++;
+
+    // Queue to traverse, in scratch memory given back on return
+    ArenaScope scope(scratch);
+    Queue qGraph(numNodes, scratch);
+
+    // Record for visited Nodes, and mark the root as visited
+    uint64_t *visNodes = visitedFrom(tmpIntree, ID, scratch);
+
+    // Enqueue the root
+    qGraph.enqueue(ID);
+
+    // Traverse till Queue is empty
+    while (!qGraph.empty())
+    {
+        // Remove the element from the Queue
+        int v = qGraph.dequeue();
+
+        // Take all the unvisited children of v, the lowest first, before func takes the edge away
+        for (int w = tmpIntree.firstChild[v], next; w != -1; w = next)
+        {
+            next = tmpIntree.nextSibling[w];
+            if (!claimNode(visNodes, w))
+                continue;
+
+            (this->*func)(w, v, tmpIntree);
+            qGraph.enqueue(w);
+        }
+    }
+}
+
+inline void Routing::extendedBFSt(size_t ID, size_t rootedAt, ParentTree &tmpIntree, nodeLevel *levels, void (Routing::*func)(size_t, size_t, ParentTree &, nodeLevel *))
+{
+    bfsTreeCalls++;
+
+    // Mark the levels as zero
+    levels[ID].level = 0;
+    levels[ID].dest = -1;
+
+    // Queue to traverse, in scratch memory given back on return
+    ArenaScope scope(scratch);
+    Queue qGraph(numNodes, scratch);
+
+    // Record for visited Nodes, and mark the root as visited
+    uint64_t *visNodes = visitedFrom(tmpIntree, ID, scratch);
+
+    // Enqueue the root
+    qGraph.enqueue(ID);
+
+    // Traverse till Queue is empty
+    while (!qGraph.empty())
+    {
+        // Remove the element from the Queue
+        int v = qGraph.dequeue();
+
+        // Take all the unvisited children of v, the lowest first, before func takes the edge away
+        for (int w = tmpIntree.firstChild[v], next; w != -1; w = next)
+        {
+            next = tmpIntree.nextSibling[w];
+            if (!claimNode(visNodes, w))
+                continue;
+
+            (this->*func)(w, v, tmpIntree, levels);
+            qGraph.enqueue(w);
+        }
+    }
+}
+
+inline void Routing::extendedBFSi(size_t ID, size_t rootedAt, ParentTree &tmpIntree, void (Routing::*func)(size_t, size_t, ParentTree &))
+{
+    bfsIntreeCalls++;
+
+    // Queue to traverse, in scratch memory given back on return
+    ArenaScope scope(scratch);
+    Queue qGraph(numNodes, scratch);
+
+    // Record for visited Nodes, and mark the root as visited
+    uint64_t *visNodes = visitedFrom(intree, rootedAt, scratch);
+
+    // Enqueue the root
+    qGraph.enqueue(rootedAt);
+
+    // Traverse till Queue is empty
+    while (!qGraph.empty())
+    {
+        // Remove the element from the Queue
+        int v = qGraph.dequeue();
+
+        // Take all the unvisited children of v, the lowest first, before func takes the edge away
+        for (int w = intree.firstChild[v], next; w != -1; w = next)
+        {
+            next = intree.nextSibling[w];
+            if (!claimNode(visNodes, w))
+                continue;
+
+            (this->*func)(w, v, tmpIntree);
+            qGraph.enqueue(w);
+        }
+    }
+}
+
+inline void Routing::extendedBFSi(size_t ID, size_t rootedAt, ParentTree &tmpIntree, nodeLevel *levels, void (Routing::*func)(size_t, size_t, ParentTree &, nodeLevel *))
+{
+    bfsIntreeCalls++;
+
+    // Mark the levels as zero
+    levels[rootedAt].level = 0;
+    levels[rootedAt].dest = -1;
+
+    // Queue to traverse, in scratch memory given back on return
+    ArenaScope scope(scratch);
+    Queue qGraph(numNodes, scratch);
+
+    // Record for visited Nodes, and mark the root as visited
+    uint64_t *visNodes = visitedFrom(intree, rootedAt, scratch);
+
+    // Enqueue the root
+    qGraph.enqueue(rootedAt);
+
+    // Traverse till Queue is empty
+    while (!qGraph.empty())
+    {
+        // Remove the element from the Queue
+        int v = qGraph.dequeue();
+
+        // Take all the unvisited children of v, the lowest first, before func takes the edge away
+        for (int w = intree.firstChild[v], next; w != -1; w = next)
+        {
+            next = intree.nextSibling[w];
+            if (!claimNode(visNodes, w))
+                continue;
+
+            (this->*func)(w, v, tmpIntree, levels);
+            qGraph.enqueue(w);
+        }
+    }
+}
+
+inline void Routing::buildSPT(size_t ID, size_t rootedAt, ParentTree &tmpIntree)
+{
+    // Store the Previous Intree
+    prevIntree = intree;
+
+    // Modify the intree of the incoming neighbor
+    tmpIntree.clearRow(ID);
+
+    extendedBFSt(ID, rootedAt, tmpIntree, &Routing::removeTmpTreePath);
+
+    tmpIntree.set(rootedAt, ID);
+
+    // Prune the dead nodes from the intree by comparing it with the last tempintree
+    extendedBFSi(ID, rootedAt, tmpIntree, &Routing::pruneNode);
+
+    // Mark all the nodes as unvisited at the start
+    ArenaScope scope(scratch);
+    nodeLevel *levelCur = scratch.take<nodeLevel>(numNodes, nodeLevel());
+    nodeLevel *levelTmp = scratch.take<nodeLevel>(numNodes, nodeLevel());
+
+    extendedBFSi(rootedAt, ID, tmpIntree, levelCur, &Routing::addLevel);
+
+    extendedBFSt(ID, rootedAt, tmpIntree, levelTmp, &Routing::addLevel);
+
+    mergeTree.clear();
+
+    // Merge the levels
+    for (int hop = 1; hop < (int)numNodes; hop++)
+    {
+        int count = numNodes;
+        while (count--)
+        {
+            int cmpLvl = -1;
+            int cmpTmp = -1;
+
+            for (size_t curLvl = 0; curLvl < numNodes; curLvl++)
+            {
+                if (levelCur[curLvl].level == hop)
+                {
+                    cmpLvl = curLvl;
+                    break;
+                }
+            }
+
+            for (size_t tmpLvl = 0; tmpLvl < numNodes; tmpLvl++)
+            {
+                if (levelTmp[tmpLvl].level == hop)
+                {
+                    cmpTmp = tmpLvl;
+                    break;
+                }
+            }
+
+            if (cmpLvl == -1 && cmpTmp == -1)
+            {
+                break;
+            }
+
+            else if ((cmpLvl != -1 && cmpTmp == -1) || (cmpLvl != -1 && cmpTmp != -1 && cmpLvl < cmpTmp))
+            {
+                int dest = levelCur[cmpLvl].dest;
+
+                if (levelTmp[cmpLvl].level == -1)
+                {
+                    mergeTree.set(cmpLvl, dest);
+                }
+                else
+                {
+                    mergeTree.set(cmpLvl, dest);
+
+                    // Modify the intree of the incoming neighbor
+                    tmpIntree.reset(cmpLvl, levelTmp[cmpLvl].dest);
+
+                    extendedBFSt(cmpLvl, rootedAt, tmpIntree, levelTmp, &Routing::removeLevel);
+                }
+
+                levelCur[cmpLvl].level = -1;
+                levelCur[cmpLvl].dest = -1;
+
+                levelTmp[cmpLvl].level = -1;
+                levelTmp[cmpLvl].dest = -1;
+            }
+
+            else if ((cmpLvl == -1 && cmpTmp != -1) || (cmpLvl != -1 && cmpTmp != -1 && cmpLvl > cmpTmp))
+            {
+                int dest = levelTmp[cmpTmp].dest;
+
+                if (levelCur[cmpTmp].level == -1)
+                {
+                    mergeTree.set(cmpTmp, dest);
+                }
+                else
+                {
+                    mergeTree.set(cmpTmp, dest);
+
+                    // Modify the intree of the myself
+                    intree.reset(cmpTmp, levelCur[cmpTmp].dest);
+
+                    extendedBFSi(ID, cmpTmp, tmpIntree, levelCur, &Routing::removeLevel);
+                }
+
+                levelTmp[cmpTmp].level = -1;
+                levelTmp[cmpTmp].dest = -1;
+
+                levelCur[cmpTmp].level = -1;
+                levelCur[cmpTmp].dest = -1;
+            }
+
+            else if (cmpLvl != -1 && cmpTmp != -1 && cmpLvl == cmpTmp)
+            {
+                int dest = levelCur[cmpLvl].dest;
+
+                mergeTree.set(cmpLvl, dest);
+
+                levelCur[cmpLvl].level = -1;
+                levelCur[cmpLvl].dest = -1;
+
+                levelTmp[cmpTmp].level = -1;
+                levelTmp[cmpTmp].dest = -1;
+            }
+        }
+    }
+
+    // Move to intree, the old one is cleared on the next merge
+    swap(intree, mergeTree);
+
+    // Check if the intree changed to push it immediately
+    if (prevIntree != intree)
+    {
+        sendIntreeNow = true;
+    }
+
+    diffIntree();
+}
+
+inline void Routing::diffIntree()
+{
+    changedEdges.clear();
+
+    // Only the nodes with a new parent hold changed edges
+    for (size_t v = 0; v < numNodes; v++)
+    {
+        int before = prevIntree.parent[v];
+        int after = intree.parent[v];
+        if (before == after)
+            continue;
+
+        if (before != -1)
+        {
+            EdgeChange change = {v, (size_t)before, false};
+            changedEdges.push_back(change);
+        }
+        if (after != -1)
+        {
+            EdgeChange change = {v, (size_t)after, true};
+            changedEdges.push_back(change);
+        }
+    }
+}
+
+inline void Routing::updateSPT(size_t ID, size_t rootedAt, const vector<pair<size_t, size_t>> &edges)
+{
+    // Parent of every node in the neighbor's intree
+    ArenaScope scope(scratch);
+    int *newParent = scratch.take<int>(numNodes, -1);
+    for (size_t i = 0; i < edges.size(); i++)
+    {
+        newParent[edges[i].first] = edges[i].second;
+    }
+
+    // Paths that go through me are no paths, so cut my subtree off
+    for (size_t v = 0; v < numNodes; v++)
+    {
+        if (newParent[v] == (int)ID)
+            newParent[v] = -1;
+    }
+
+    // The neighbor itself is one hop away
+    newParent[rootedAt] = ID;
+
+    replaceNeighborTree(ID, rootedAt, newParent);
+}
+
+inline void Routing::dropNeighborTree(size_t ID, size_t rootedAt)
+{
+    // Nothing reaches me through a dead neighbor
+    ArenaScope scope(scratch);
+    int *newParent = scratch.take<int>(numNodes, -1);
+
+    replaceNeighborTree(ID, rootedAt, newParent);
+}
+
+inline void Routing::replaceNeighborTree(size_t ID, size_t rootedAt, int *newParent)
+{
+    changedEdges.clear();
+
+    vector<int> &oldParent = neighborParent[rootedAt];
+    vector<int> &oldDepth = neighborDepth[rootedAt];
+
+    // First intree of this neighbor
+    if (oldParent.empty())
+    {
+        oldParent.assign(numNodes, -1);
+        oldDepth.assign(numNodes, -1);
+        treeNeighbors.push_back(rootedAt);
+    }
+
+    // Hops to me along the neighbor's intree, -1 if it never gets here
+    ArenaScope scope(scratch);
+    int *newDepth = scratch.take<int>(numNodes);
+    hopsToRoot(ID, newParent, newDepth, numNodes, scratch);
+
+    // Only the nodes that moved inside the neighbor's tree need a new parent
+    for (size_t v = 0; v < numNodes; v++)
+    {
+        if (v == ID || (newParent[v] == oldParent[v] && newDepth[v] == oldDepth[v]))
+            continue;
+
+        oldParent[v] = newParent[v];
+        oldDepth[v] = newDepth[v];
+
+        // Pick the neighbor with the fewest hops, the lowest on a tie
+        int best = -1;
+        for (size_t n = 0; n < treeNeighbors.size(); n++)
+        {
+            int depth = neighborDepth[treeNeighbors[n]][v];
+            if (depth == -1)
+                continue;
+
+            if (best == -1 || depth < neighborDepth[best][v] || (depth == neighborDepth[best][v] && (int)treeNeighbors[n] < best))
+                best = treeNeighbors[n];
+        }
+
+        int next = (best == -1) ? -1 : neighborParent[best][v];
+        if (next == parent[v])
+            continue;
+
+        // Swap the edge and remember it
+        if (parent[v] != -1)
+        {
+            intree.reset(v, parent[v]);
+            EdgeChange change = {v, (size_t)parent[v], false};
+            changedEdges.push_back(change);
+        }
+        if (next != -1)
+        {
+            intree.set(v, next);
+            EdgeChange change = {v, (size_t)next, true};
+            changedEdges.push_back(change);
+        }
+
+        parent[v] = next;
+    }
+
+    // A dead neighbor has nothing on record anymore
+    if (newDepth[rootedAt] == -1)
+    {
+        for (size_t n = 0; n < treeNeighbors.size(); n++)
+        {
+            if (treeNeighbors[n] == rootedAt)
+            {
+                treeNeighbors.erase(treeNeighbors.begin() + n);
+                break;
+            }
+        }
+        oldParent.clear();
+        oldDepth.clear();
+    }
+
+    // Push the intree immediately if it changed
+    if (!changedEdges.empty())
+    {
+        sendIntreeNow = true;
+    }
+}
+
+inline void Routing::weightedSPT(size_t ID, size_t rootedAt, const vector<pair<size_t, size_t>> &edges, const vector<uint32_t> &costs)
+{
+    vector<int> &treeParent = neighborParent[rootedAt];
+    vector<uint32_t> &treeCost = neighborCost[rootedAt];
+
+    // First intree of this neighbor
+    if (treeParent.empty())
+        treeNeighbors.push_back(rootedAt);
+
+    treeParent.assign(numNodes, -1);
+    treeCost.assign(numNodes, 1);
+
+    // Parent and cost of every node in the neighbor's intree, paths that go through me are no paths
+    for (size_t i = 0; i < edges.size(); i++)
+    {
+        if (edges[i].second == ID || edges[i].first == ID)
+            continue;
+
+        treeParent[edges[i].first] = edges[i].second;
+        treeCost[edges[i].first] = (i < costs.size()) ? costs[i] : 1;
+    }
+
+    // The neighbor itself is a single link away
+    treeParent[rootedAt] = ID;
+    treeCost[rootedAt] = linkCost[rootedAt];
+
+    dijkstraSPT(ID);
+}
+
+inline void Routing::dropWeightedTree(size_t ID, size_t rootedAt)
+{
+    // Nothing reaches me through a dead neighbor
+    for (size_t n = 0; n < treeNeighbors.size(); n++)
+    {
+        if (treeNeighbors[n] == rootedAt)
+        {
+            treeNeighbors.erase(treeNeighbors.begin() + n);
+            break;
+        }
+    }
+    neighborParent[rootedAt].clear();
+    neighborCost[rootedAt].clear();
+
+    dijkstraSPT(ID);
+}
+
+inline bool Routing::setLinkCost(size_t ID, size_t from, uint32_t cost)
+{
+    if (linkCost[from] == cost)
+        return false;
+
+    linkCost[from] = cost;
+
+    // The neighbor's intree gets to me over that link
+    if (sptMode != WEIGHTED_SPT || neighborParent[from].empty())
+        return false;
+
+    neighborCost[from][from] = cost;
+    dijkstraSPT(ID);
+    return true;
+}
+
+inline void Routing::dijkstraSPT(size_t ID)
+{
+    changedEdges.clear();
+    ArenaScope scope(scratch);
+
+    // Edges v -> p of all the neighbors' intrees, grouped by p to walk them back from me
+    size_t *first = scratch.take<size_t>(numNodes + 1, 0);
+    for (size_t n = 0; n < treeNeighbors.size(); n++)
+    {
+        const vector<int> &treeParent = neighborParent[treeNeighbors[n]];
+        for (size_t v = 0; v < numNodes; v++)
+            if (treeParent[v] != -1)
+                first[treeParent[v] + 1]++;
+    }
+    for (size_t v = 0; v < numNodes; v++)
+        first[v + 1] += first[v];
+
+    size_t *fill = scratch.take<size_t>(numNodes);
+    copy(first, first + numNodes, fill);
+    size_t *child = scratch.take<size_t>(first[numNodes]);
+    uint32_t *weight = scratch.take<uint32_t>(first[numNodes]);
+    for (size_t n = 0; n < treeNeighbors.size(); n++)
+    {
+        const vector<int> &treeParent = neighborParent[treeNeighbors[n]];
+        const vector<uint32_t> &treeCost = neighborCost[treeNeighbors[n]];
+        for (size_t v = 0; v < numNodes; v++)
+        {
+            if (treeParent[v] == -1)
+                continue;
+
+            size_t k = fill[treeParent[v]]++;
+            child[k] = v;
+            weight[k] = treeCost[v];
+        }
+    }
+
+    // Cost from every node to me, the next node on the way and the cost of the link to it
+    uint64_t *dist = scratch.take<uint64_t>(numNodes, UINT64_MAX);
+    int *next = scratch.take<int>(numNodes, -1);
+    uint32_t *nextCost = scratch.take<uint32_t>(numNodes, 1);
+
+    CostHeap heap(numNodes, dist, scratch);
+    dist[ID] = 0;
+    heap.push(ID);
+
+    while (!heap.empty())
+    {
+        size_t u = heap.pop();
+
+        // Every node with an edge into u may get to me cheaper through it
+        for (size_t k = first[u]; k < first[u + 1]; k++)
+        {
+            size_t v = child[k];
+            uint64_t d = dist[u] + weight[k];
+
+            // The lowest next node on a tie, so the tree does not depend on the order of the intrees
+            if (d < dist[v] || (d == dist[v] && (int)u < next[v]))
+            {
+                dist[v] = d;
+                next[v] = u;
+                nextCost[v] = weight[k];
+                heap.push(v);
+            }
+        }
+    }
+
+    // Swap the edges that changed and remember them
+    for (size_t v = 0; v < numNodes; v++)
+    {
+        if (v == ID)
+            continue;
+
+        // A new cost on the same edge goes out with the next intree too
+        if (next[v] == parent[v])
+        {
+            if (next[v] != -1 && nextCost[v] != parentCost[v])
+                sendIntreeNow = true;
+            parentCost[v] = nextCost[v];
+            continue;
+        }
+
+        if (parent[v] != -1)
+        {
+            intree.reset(v, parent[v]);
+            EdgeChange change = {v, (size_t)parent[v], false};
+            changedEdges.push_back(change);
+        }
+        if (next[v] != -1)
+        {
+            intree.set(v, next[v]);
+            EdgeChange change = {v, (size_t)next[v], true};
+            changedEdges.push_back(change);
+        }
+
+        parent[v] = next[v];
+        parentCost[v] = nextCost[v];
+    }
+
+    // Push the intree immediately if it changed
+    if (!changedEdges.empty())
+    {
+        sendIntreeNow = true;
+    }
+}
+
+// What a node puts in its intree advertisements
+enum IntreeMode
+{
+    // The whole intree every time
+    FULL_INTREE,
+    // Only the edges that changed, with a snapshot now and then
+    DELTA_INTREE
+};
+
+// Intree of an incoming neighbor as its advertisements built it up (delta mode)
+struct NeighborAdvert
+{
+    // Sequence number of the last snapshot or delta applied
+    uint64_t seq = 0;
+
+    // False until a snapshot came in, and again after a missed delta
+    bool synced = false;
+
+    // The tree changed, or the own intree lost something it may give back, since the last merge
+    bool dirty = false;
+
+    // A resync went out for the current gap
+    bool resyncSent = false;
+
+    // Parent of every node in the neighbor's intree, -1 if absent, and the cost of the edge to it
+    vector<int> parent;
+    vector<uint32_t> cost;
+};
+
+// Liveness of an incoming neighbor, with --keepalive-ms
+struct NeighborLiveness
+{
+    // Checks in a row without a word from it
+    size_t missed = 0;
+
+    // Recent deaths, every one past the first doubles the hold-down
+    size_t flaps = 0;
+
+    // Checks before it may come back
+    size_t holdDown = 0;
+
+    // Checks it stayed up since a death was last forgiven
+    size_t upChecks = 0;
+};
+
+// Settings of a node given on the command line
+struct NodeOptions
+{
+    // Total number of nodes in the network
+    size_t numNodes = NUMNODES;
+
+    // Backend of the channels
+    ChannelBackend backend = FILE_BACKEND;
+
+    // Merge strategy of the received intrees
+    SptMode spt = FULL_SPT;
+
+    // Content of the intree advertisements
+    IntreeMode intree = FULL_INTREE;
+
+    // Format of the messages on the channels
+    WireFormat wire = TEXT_WIRE;
+
+    // Bound on the time a message waits in the write batch
+    long flushMs = FLUSH_LATENCY_MS;
+
+    // Seconds between two writes of the stats file, 0 for none
+    size_t statsPeriod = 0;
+
+    // Bound and policy of the forwarding queue of every next hop
+    size_t queueLimit = FORWARD_LIMIT;
+    QueuePolicy queuePolicy = BACKPRESSURE;
+
+    // Milliseconds between two keepalives, 0 to let the intree tell who is alive
+    long keepaliveMs = 0;
+
+    // Keepalives missed before a neighbor is dead, and its hold-down once it flaps
+    size_t missedLimit = MISSED_LIMIT;
+    long holdDownMs = HOLD_DOWN_MS;
+
+    // Flows of the whole network, every node sends its own
+    vector<FlowSpec> flows;
+
+    // Equal-hop paths a destination's data is spread over, 1 for a single path
+    size_t multipath = 1;
+};
+
+// Source route to a destination, kept until the intree changes
+struct CachedRoute
+{
+    enum
+    {
+        // Not computed since the last change
+        UNKNOWN,
+        // The destination is not reachable
+        NO_ROUTE,
+        // route holds the intermediate nodes
+        FOUND
+    } state = UNKNOWN;
+
+    // Incoming neighbor the route goes to
+    size_t via = 0;
+
+    // Intermediate nodes, as they go in the data message
+    vector<size_t> route;
+
+    // Routes through every incoming neighbor with the fewest hops, the first paths of them in use (multipath only)
+    vector<vector<size_t>> alternatives;
+    size_t paths = 0;
+};
+
+// Hash of a flow at the node that picks its path, the same for all its packets so they keep their order on a single path
+// Every node salts it with its own ID, or all the hops of a flow would make the same choice
+inline uint64_t flowHash(size_t src, size_t dest, size_t flow, size_t node)
+{
+    uint64_t h = src * 0x9E3779B97F4A7C15ULL ^ dest * 0xC2B2AE3D27D4EB4FULL ^ flow * 0x165667B19E3779F9ULL ^ node * 0xD6E8FEB86659FD93ULL;
+
+    // Mix the bits, as the finalizer of splitmix64
+    h ^= h >> 30;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 27;
+    h *= 0x94D049BB133111EBULL;
+    h ^= h >> 31;
+    return h;
+}
+
+// Counters of the traffic of a node
+struct NodeStats
+{
+    // Messages the node wrote
+    Counter helloSent;
+    Counter intreeSent;
+    Counter snapshotSent;
+    Counter resyncSent;
+    Counter dataSent;
+    Counter dataForwarded;
+
+    // Bytes of the hello and intree messages, and of the data messages
+    Counter controlBytes;
+    Counter dataBytes;
+
+    // Messages and bytes the node read, by type (snapshots, deltas and resyncs count as intree)
+    Counter helloRead;
+    Counter intreeRead;
+    Counter dataRead;
+    Counter invalidRead;
+    Counter bytesRead;
+
+    // Data messages delivered to the node, in total and per source
+    Counter dataReceived;
+    vector<size_t> receivedFrom;
+
+    // Data dropped for a lack of route (the forwarding queue counts its own drops)
+    Counter droppedNoRoute;
+
+    // Times a full hop made the node write the queue out before reading on
+    Counter backpressureFlushes;
+
+    // Data waiting for the neighbors at the last flush, and the most ever
+    Counter queueDepth;
+    Counter queueDepthPeak;
+
+    // Merges of received intrees, and their time
+    Counter sptMerges;
+    Histogram sptTime;
+
+    // Received intrees that changed the own intree
+    Counter intreeChanges;
+
+    // Deltas that did not follow the last sequence number of their neighbor
+    Counter intreeGaps;
+
+    // Neighbors found dead, and messages ignored from those held down
+    Counter neighborDeaths;
+    Counter heldDownRead;
+
+    // Source routes taken from the cache, and computed again
+    Counter routeHits;
+    Counter routeMisses;
+
+    // Scratch memory held by the node
+    Counter arenaBytes;
+};
+
+class Node
+{
+public:
+    Node(size_t ID, size_t duration, int dest, string dataMessage, const NodeOptions &options) : ID(ID), numNodes(options.numNodes), duration(duration), gotIntree(numNodes, false), liveness(numNodes), msg(numNodes, dest, dataMessage), routes(numNodes), tmpIntree(numNodes), adverts(numNodes)
+    {
+        msg.sptMode = options.spt;
+        intreeMode = options.intree;
+        keepaliveMs = options.keepaliveMs;
+        missedLimit = options.missedLimit;
+        holdDownMs = options.holdDownMs;
+        traffic.setup(options.flows, ID);
+        multipath = options.multipath;
+        if (multipath > 1)
+            hopsVia.resize(numNodes);
+        clock = []() { return monotonicNs() / 1000; };
+        msg.forward.limit = options.queueLimit;
+        msg.forward.policy = options.queuePolicy;
+        channel.backend = options.backend;
+        channel.wire = options.wire;
+        channel.flushMs = options.flushMs;
+        statsPeriod = options.statsPeriod;
+        setChannels();
+    };
+    ~Node();
+
+    // ID of the node
+    size_t ID;
+
+    // Total number of nodes in the network
+    size_t numNodes;
+
+    // Duration
+    size_t duration;
+
+    // Counters of the traffic of the node
+    NodeStats stats;
+
+    // Write the counters to <ID>_stats.prom
+    void exportStats();
+
+    // Nodes with a path to this node in its intree
+    size_t intreeSize();
+
+    // Flows this node received, by flow number
+    const map<size_t, FlowReceived> &flowsReceived() const { return sink.flows; };
+
+    // Hello Message Sender
+    void helloProtocol();
+
+    // Intree Protocol
+    void intreeProtocol();
+
+    // Data Protocol
+    void dataProtocol();
+
+    // Send the packets of the flows that are due
+    void trafficProtocol();
+
+    // Time the next packet of a flow is due, false once the flows stopped
+    bool trafficDue(uint64_t &at) const { return traffic.due(at); };
+
+    // Microseconds on the clock of the flows, the monotonic clock unless a simulation keeps its own
+    function<uint64_t()> clock;
+
+    // Write what the flows sent and received to <ID>_flows
+    void reportFlows();
+
+    // Process Input File
+    void processInputFile();
+
+    // Run the protocols off timers and input events for the whole duration
+    void run();
+
+    // What wakes up the event loop of a node
+    enum NodeEvent
+    {
+        HELLO_EVENT,
+        INTREE_EVENT,
+        DATA_EVENT,
+        CHECK_EVENT,
+        LIVENESS_EVENT,
+        TRAFFIC_EVENT,
+        INPUT_EVENT,
+        STATS_EVENT
+    };
+
+    // Handle a single event of the event loop, for callers that keep their own clock
+    void handleEvent(NodeEvent);
+
+private:
+    // Keep record of who sent the intree message, or anything at all with keepalives
+    vector<bool> gotIntree;
+
+    // Keepalive period, missed keepalives before a death and the first hold-down
+    long keepaliveMs = 0;
+    size_t missedLimit = MISSED_LIMIT;
+    long holdDownMs = HOLD_DOWN_MS;
+
+    // Liveness of every incoming neighbor, with keepalives
+    vector<NeighborLiveness> liveness;
+
+    // Content of the intree advertisements
+    IntreeMode intreeMode = FULL_INTREE;
+
+    // Seconds between two writes of the stats file, 0 for none
+    size_t statsPeriod = 0;
+
+    // Number of processInputFile ticks so far
+    size_t timer = 0;
+
+    // Channels of the Node
+    FileDescriptor channel;
+
+    // File with the data received by the node
+    string receivedFileName;
+    ofstream receivedData;
+
+    // Routing Data Structure
+    Routing msg;
+
+    // Message being read, in place in the channel, and its decoded form
+    MessageView line;
+    Message received;
+
+    // Message being written, reused to keep its buffer
+    string outBuffer;
+
+    // Source route to every destination
+    vector<CachedRoute> routes;
+
+    // Flows the node sends, and the flows it receives
+    TrafficGenerator traffic;
+    TrafficSink sink;
+
+    // Equal-hop paths a destination's data is spread over, and the hops to me through every incoming neighbor's intree
+    size_t multipath = 1;
+    vector<vector<int>> hopsVia;
+
+    // Path to the neighbor before its intree came in, reused to keep its buffer
+    vector<size_t> previousPath;
+
+    // Received intree, path to a destination and edges of the own intree, reused to keep their buffers
+    ParentTree tmpIntree;
+    vector<size_t> destPath;
+    vector<pair<size_t, size_t>> treeEdges;
+
+    // Cost of every edge of the own intree, and of those added since the last advertisement (weighted only)
+    vector<uint32_t> treeCosts;
+    vector<uint32_t> addedCosts;
+
+    // Own intree as last advertised and as it is now, by parent and edge cost, and the edges in between (delta mode)
+    vector<int> advertParent;
+    vector<int> currentParent;
+    vector<uint32_t> advertCost;
+    vector<uint32_t> currentCost;
+    vector<pair<size_t, size_t>> addedEdges;
+    vector<pair<size_t, size_t>> removedEdges;
+
+    // Sequence number of the own intree, and intree periods so far (delta mode)
+    uint64_t advertSeq = 0;
+    size_t intreePeriods = 0;
+
+    // The next advertisement is a snapshot
+    bool snapshotNow = false;
+
+    // Intree of every incoming neighbor, and the message a merge is fed from (delta mode)
+    vector<NeighborAdvert> adverts;
+    Message advertTree;
+
+    // init the channels
+    void setChannels();
+
+    // Return the path to the destination
+    void findPathToDest(size_t, vector<size_t> &);
+
+    // Return the path to the incoming neighbor that leads to the destination, NULL if there is none
+    // With multipath the hash of the flow picks one of the equal-hop paths
+    const vector<size_t> *findRouteToDest(size_t, uint64_t);
+
+    // Find the routes through the incoming neighbors with the fewest hops from the destination
+    void findAlternatives(size_t);
+
+    // Record the hops to me through a neighbor's intree, or the cost in weighted mode
+    void updateHopsVia(size_t, const Message &);
+
+    // Forget every cached route
+    void forgetRoutes();
+
+    // Forget the cached routes through an incoming neighbor
+    void forgetRoutesVia(size_t);
+
+    // Compute the Hello Messages
+    void computeHello(const Message &);
+
+    // Compute the intree Messages
+    void computeIntree(const Message &);
+
+    // Apply a snapshot or a delta, and merge the tree if it changed
+    void computeAdvert(const Message &);
+
+    // Merge the trees of the synced neighbors again at their next advertisement
+    void markAdvertsDirty(size_t);
+
+    // Send the intree, whole or as a delta depending on the mode
+    void advertiseIntree();
+
+    // Compute the Data Messages
+    void computeData(const Message &);
+
+    // Read every pending line of the input file
+    void readInput();
+
+    // Drop the incoming neighbors that stopped sending the intree
+    void checkNeighbors();
+
+    // Send a keepalive, and drop the incoming neighbors that missed too many
+    void checkLiveness();
+
+    // Take a dead neighbor and its subtree out of the intree
+    void dropNeighbor(size_t);
+
+    // True while a neighbor that flapped is kept out
+    bool heldDown(size_t i) { return liveness[i].holdDown > 0; };
+
+    // Merge the tree of a neighbor built up from its advertisements
+    void mergeAdvert(size_t);
+
+    // Push the changed intree and the data waiting for the neighbors
+    void flushPending();
+
+    // Write the data waiting for the neighbors to the channel
+    void drainForward();
+
+    // Edges (child parent) of the intree, in BFS order from the node
+    void intreeEdges(vector<pair<size_t, size_t>> &);
+
+    // Create a timer that expires after first and then every period milliseconds
+    int createTimer(int, long, long);
+
+    // Arm the timer of the flows for their next packet
+    void armTraffic(int);
+};
+
+inline Node::~Node()
+{
+    // Close the channels
+    channel.close();
+    receivedData.close();
+}
+
+inline void Node::setChannels()
+{
+    channel.inputFileName = "input_" + to_string(ID);
+    channel.outputFileName = "output_" + to_string(ID);
+    receivedFileName = to_string(ID) + "_received";
+
+    receivedData.open(receivedFileName.c_str(), ios::out | ios::app);
+
+    if (!channel.openInput(true))
+    {
+        cout << "Node " << ID << ": No input file" << endl;
+        exit(1);
+    }
+    if (!channel.openOutput(true))
+    {
+        cout << "Node " << ID << ": No output file" << endl;
+        exit(1);
+    }
+    if (receivedData.fail())
+    {
+        cout << "Node " << ID << ": No receivedData file" << endl;
+        exit(1);
+    }
+}
+
+inline void Node::helloProtocol()
+{
+    // Send the Hello Message on the Output file for the controller to read
+    encodeHello(channel.wire, ID, outBuffer);
+    channel.writeMessage(outBuffer);
+
+    stats.helloSent++;
+    stats.controlBytes += outBuffer.length();
+}
+
+inline void Node::intreeEdges(vector<pair<size_t, size_t>> &edges)
+{
+    edges.clear();
+
+    // Check the status of incoming Neighbors
+    if (!msg.isINempty())
+    {
+        // Traverse the Intree
+        ArenaScope scope(msg.scratch);
+        Queue qCurNode(numNodes, msg.scratch);
+
+        // Visit Node, and mark it visited
+        uint64_t *visCur = visitedFrom(msg.intree, ID, msg.scratch);
+
+        // Enqueue the Node
+        qCurNode.enqueue(ID);
+
+        // Check if a Current Node Queue is empty
+        while (!qCurNode.empty())
+        {
+            // Remove the element from the Queue
+            int v = qCurNode.dequeue();
+
+            // Take all the unvisited children of v, the lowest first
+            for (int w = msg.intree.firstChild[v]; w != -1; w = msg.intree.nextSibling[w])
+            {
+                if (!claimNode(visCur, w))
+                    continue;
+
+                qCurNode.enqueue(w);
+                edges.push_back(make_pair(w, v));
+            }
+        }
+    }
+}
+
+inline size_t Node::intreeSize()
+{
+    vector<pair<size_t, size_t>> edges;
+    intreeEdges(edges);
+
+    // Every node but the root has its edge
+    return edges.size();
+}
+
+inline void Node::intreeProtocol()
+{
+    // Every few periods the delta is a whole snapshot instead, the first one included
+    if (intreeMode == DELTA_INTREE && intreePeriods++ % SNAPSHOT_PERIODS == 0)
+        snapshotNow = true;
+
+    advertiseIntree();
+}
+
+inline void Node::advertiseIntree()
+{
+    // Edges of the intree, as (child parent)
+    intreeEdges(treeEdges);
+
+    // With their costs when they are weighted
+    const vector<uint32_t> *costs = NULL;
+    if (msg.sptMode == WEIGHTED_SPT)
+    {
+        treeCosts.resize(treeEdges.size());
+        for (size_t i = 0; i < treeEdges.size(); i++)
+            treeCosts[i] = msg.parentCost[treeEdges[i].first];
+        costs = &treeCosts;
+    }
+
+    if (intreeMode == FULL_INTREE)
+    {
+        // write to the file
+        encodeIntree(channel.wire, ID, treeEdges, outBuffer, costs);
+        channel.writeMessage(outBuffer);
+
+        stats.intreeSent++;
+        stats.controlBytes += outBuffer.length();
+        return;
+    }
+
+    if (advertParent.empty())
+    {
+        advertParent.assign(numNodes, -1);
+        currentParent.assign(numNodes, -1);
+        advertCost.assign(numNodes, 1);
+        currentCost.assign(numNodes, 1);
+    }
+
+    // Every node has a single parent in the intree
+    fill(currentParent.begin(), currentParent.end(), -1);
+    for (size_t i = 0; i < treeEdges.size(); i++)
+    {
+        currentParent[treeEdges[i].first] = treeEdges[i].second;
+        currentCost[treeEdges[i].first] = costs ? treeCosts[i] : 1;
+    }
+
+    // Edges that changed since the last advertisement, a new cost takes the edge out and back in
+    addedEdges.clear();
+    removedEdges.clear();
+    addedCosts.clear();
+    for (size_t v = 0; v < numNodes; v++)
+    {
+        if (currentParent[v] == advertParent[v] && (currentParent[v] == -1 || currentCost[v] == advertCost[v]))
+            continue;
+
+        if (advertParent[v] != -1)
+            removedEdges.push_back(make_pair(v, (size_t)advertParent[v]));
+        if (currentParent[v] != -1)
+        {
+            addedEdges.push_back(make_pair(v, (size_t)currentParent[v]));
+            addedCosts.push_back(currentCost[v]);
+        }
+    }
+
+    // A change takes the next sequence number, an empty delta only says the node is alive
+    if (!addedEdges.empty() || !removedEdges.empty())
+        advertSeq++;
+    advertParent.swap(currentParent);
+    advertCost.swap(currentCost);
+
+    if (snapshotNow)
+    {
+        encodeSnapshot(channel.wire, ID, advertSeq, treeEdges, outBuffer, costs);
+        stats.snapshotSent++;
+        snapshotNow = false;
+    }
+    else
+    {
+        encodeDelta(channel.wire, ID, advertSeq, addedEdges, removedEdges, outBuffer, costs ? &addedCosts : NULL);
+        stats.intreeSent++;
+    }
+
+    channel.writeMessage(outBuffer);
+    stats.controlBytes += outBuffer.length();
+}
+
+inline void Node::findPathToDest(size_t v, vector<size_t> &path)
+{
+    // Store the path, from the destination up to me
+    msg.intree.pathUp(v, path);
+}
+
+inline const vector<size_t> *Node::findRouteToDest(size_t dest, uint64_t flow)
+{
+    CachedRoute &cached = routes[dest];
+    if (cached.state != CachedRoute::UNKNOWN)
+    {
+        stats.routeHits++;
+        if (cached.state == CachedRoute::NO_ROUTE)
+            return NULL;
+        return multipath > 1 ? &cached.alternatives[flow % cached.paths] : &cached.route;
+    }
+
+    stats.routeMisses++;
+    cached.state = CachedRoute::NO_ROUTE;
+
+    if (multipath > 1)
+    {
+        findAlternatives(dest);
+        return cached.state == CachedRoute::FOUND ? &cached.alternatives[flow % cached.paths] : NULL;
+    }
+
+    // Find the new path
+    destPath.clear();
+    findPathToDest(dest, destPath);
+
+    // Check if the destination is in the intree at all
+    if (destPath.size() < 2)
+        return NULL;
+
+    // Find the Incoming Neighbor
+    size_t in = destPath[destPath.size() - 2];
+    cached.via = in;
+
+    if (msg.pathToIncomingNeighbors[in].empty())
+        return NULL;
+
+    // Leave myself out of the path
+    cached.route.assign(msg.pathToIncomingNeighbors[in].begin() + 1, msg.pathToIncomingNeighbors[in].end());
+    cached.state = CachedRoute::FOUND;
+
+    return &cached.route;
+}
+
+inline void Node::findAlternatives(size_t dest)
+{
+    CachedRoute &cached = routes[dest];
+    cached.paths = 0;
+
+    // Fewest hops from the destination to me through any incoming neighbor I can reach
+    int best = -1;
+    for (size_t n = 0; n < numNodes; n++)
+    {
+        if (msg.incomingNeighbors[n] != 1 || hopsVia[n].empty() || msg.pathToIncomingNeighbors[n].empty())
+            continue;
+
+        int hops = hopsVia[n][dest];
+        if (hops != -1 && (best == -1 || hops < best))
+            best = hops;
+    }
+
+    if (best == -1)
+        return;
+
+    // Every neighbor with that many, the lowest first, up to the limit
+    for (size_t n = 0; n < numNodes && cached.paths < multipath; n++)
+    {
+        if (msg.incomingNeighbors[n] != 1 || hopsVia[n].empty() || msg.pathToIncomingNeighbors[n].empty() || hopsVia[n][dest] != best)
+            continue;
+
+        // Leave myself out of the path, and keep the buffers of the routes from before
+        if (cached.paths == cached.alternatives.size())
+            cached.alternatives.push_back(vector<size_t>());
+        cached.alternatives[cached.paths].assign(msg.pathToIncomingNeighbors[n].begin() + 1, msg.pathToIncomingNeighbors[n].end());
+        cached.paths++;
+    }
+
+    cached.state = CachedRoute::FOUND;
+}
+
+inline void Node::updateHopsVia(size_t rootedAt, const Message &tree)
+{
+    // Parent of every node in the neighbor's intree, and the cost of the edge to it
+    ArenaScope scope(msg.scratch);
+    int *parent = msg.scratch.take<int>(numNodes, -1);
+    uint32_t *cost = msg.scratch.take<uint32_t>(numNodes, 1);
+    for (size_t i = 0; i < tree.edges.size(); i++)
+    {
+        parent[tree.edges[i].first] = tree.edges[i].second;
+        cost[tree.edges[i].first] = edgeCost(tree, i);
+    }
+
+    // Paths that go through me are no paths, and the neighbor itself is one link away
+    for (size_t v = 0; v < numNodes; v++)
+        if (parent[v] == (int)ID)
+            parent[v] = -1;
+    parent[rootedAt] = ID;
+    cost[rootedAt] = msg.linkCost[rootedAt];
+
+    // Equal-cost paths instead of equal-hop ones when the links are weighted
+    int *hops = msg.scratch.take<int>(numNodes);
+    hopsToRoot(ID, parent, hops, numNodes, msg.scratch, msg.sptMode == WEIGHTED_SPT ? cost : NULL);
+
+    vector<int> &known = hopsVia[rootedAt];
+    if (known.size() == numNodes && equal(known.begin(), known.end(), hops))
+        return;
+
+    // The neighbor may tie with the others, or stop to, for any destination
+    known.assign(hops, hops + numNodes);
+    forgetRoutes();
+}
+
+inline void Node::forgetRoutes()
+{
+    for (size_t i = 0; i < numNodes; i++)
+        routes[i].state = CachedRoute::UNKNOWN;
+}
+
+inline void Node::forgetRoutesVia(size_t in)
+{
+    // Any route may go through the neighbor with multipath
+    if (multipath > 1)
+    {
+        forgetRoutes();
+        return;
+    }
+
+    for (size_t i = 0; i < numNodes; i++)
+        if (routes[i].via == in)
+            routes[i].state = CachedRoute::UNKNOWN;
+}
+
+inline void Node::dataProtocol()
+{
+    // Send the Data Message if the destination is not -1
+    if (msg.dest != -1)
+    {
+        const vector<size_t> *route = findRouteToDest(msg.dest, flowHash(ID, msg.dest, 0, ID));
+        if (route == NULL)
+        {
+            stats.droppedNoRoute++;
+            return;
+        }
+
+        // Send the data to the Incoming Neighbor
+        encodeData(channel.wire, ID, msg.dest, route->data(), route->size(), msg.dataMessage.data(), msg.dataMessage.length(), outBuffer);
+        channel.writeMessage(outBuffer);
+
+        stats.dataSent++;
+        stats.dataBytes += outBuffer.length();
+    }
+}
+
+inline void Node::trafficProtocol()
+{
+    traffic.run(clock(), [this](size_t flow, size_t dest, const string &payload) {
+        const vector<size_t> *route = findRouteToDest(dest, flowHash(ID, dest, flow, ID));
+        if (route == NULL)
+        {
+            stats.droppedNoRoute++;
+            return false;
+        }
+
+        // Same as the data message of the command line
+        encodeData(channel.wire, ID, dest, route->data(), route->size(), payload.data(), payload.length(), outBuffer);
+        channel.writeMessage(outBuffer);
+
+        stats.dataSent++;
+        stats.dataBytes += outBuffer.length();
+        return true;
+    });
+}
+
+inline void Node::reportFlows()
+{
+    if (!traffic.flows.empty() || !sink.flows.empty())
+        writeFlowReport(to_string(ID) + "_flows", traffic, sink);
+}
+
+inline void Node::computeHello(const Message &hello)
+{
+    // Read the Input file to check for the message
+    // and then update the incoming neighbors
+
+    // A hello is a keepalive too
+    if (keepaliveMs)
+        gotIntree[hello.src] = true;
+
+    // A neighbor that flapped stays out until its hold-down is over
+    if (heldDown(hello.src))
+    {
+        stats.heldDownRead++;
+        return;
+    }
+
+    // Update the Incoming Neighbors
+    msg.incomingNeighbors[hello.src] = 1;
+
+    // The cost of the link may have changed under the intree
+    if (msg.setLinkCost(ID, hello.src, hello.cost) && !msg.changedEdges.empty())
+    {
+        stats.intreeChanges++;
+        forgetRoutes();
+    }
+}
+
+inline void Node::computeIntree(const Message &tree)
+{
+
+    // Read the input file
+    // Update the Intree
+    // Make the Intree with the help of the Intree message and Incoming neighbors
+
+    // Find who sent this message
+    size_t rootedAt = tree.src;
+
+    // Store in the who sent Intree
+    gotIntree[rootedAt] = true;
+
+    // A neighbor that flapped stays out until its hold-down is over
+    if (heldDown(rootedAt))
+    {
+        stats.heldDownRead++;
+        return;
+    }
+
+    // Create a temporary Intree of the received Intree message
+    tmpIntree.clear();
+
+    // Place a directed edge for every pair
+    for (size_t i = 0; i < tree.edges.size(); i++)
+    {
+        tmpIntree.set(tree.edges[i].first, tree.edges[i].second);
+    }
+
+    //Refresh the Contents in Path To Incoming Neighbor
+    previousPath.swap(msg.pathToIncomingNeighbors[rootedAt]);
+    msg.pathToIncomingNeighbors[rootedAt].clear();
+    // Find the path to the Incoming Neighbor
+    msg.storePathToIncomingNeighbor(ID, rootedAt, tmpIntree);
+    // Check if the path was empty or not
+    if (msg.pathToIncomingNeighbors[rootedAt].size() == 1)
+        msg.pathToIncomingNeighbors[rootedAt].clear();
+
+    // Routes through this neighbor follow the new path
+    if (previousPath != msg.pathToIncomingNeighbors[rootedAt])
+        forgetRoutesVia(rootedAt);
+
+    // Merge the two trees
+    uint64_t start = monotonicNs();
+    if (msg.sptMode == INCREMENTAL_SPT)
+        msg.updateSPT(ID, rootedAt, tree.edges);
+    else if (msg.sptMode == WEIGHTED_SPT)
+        msg.weightedSPT(ID, rootedAt, tree.edges, tree.costs);
+    else
+        msg.buildSPT(ID, rootedAt, tmpIntree);
+
+    stats.sptMerges++;
+    stats.sptTime.observe(monotonicNs() - start);
+
+    // Multipath keeps every neighbor's hops, not just those of the tree that won
+    if (multipath > 1)
+        updateHopsVia(rootedAt, tree);
+
+    if (!msg.changedEdges.empty())
+    {
+        stats.intreeChanges++;
+        forgetRoutes();
+
+        // buildSPT may have pruned what the other neighbors offer, so their trees go in again
+        if (intreeMode == DELTA_INTREE && msg.sptMode == FULL_SPT)
+            markAdvertsDirty(rootedAt);
+    }
+}
+
+inline void Node::markAdvertsDirty(size_t except)
+{
+    for (size_t i = 0; i < numNodes; i++)
+        if (i != except && adverts[i].synced)
+            adverts[i].dirty = true;
+}
+
+inline void Node::computeAdvert(const Message &advert)
+{
+    size_t rootedAt = advert.src;
+
+    // Any advertisement says the neighbor is alive
+    gotIntree[rootedAt] = true;
+
+    NeighborAdvert &known = adverts[rootedAt];
+    if (known.parent.empty())
+    {
+        known.parent.assign(numNodes, -1);
+        known.cost.assign(numNodes, 1);
+    }
+
+    if (advert.type == SNAPSHOT_MESSAGE)
+    {
+        // The whole tree, whatever came before
+        fill(known.parent.begin(), known.parent.end(), -1);
+        for (size_t i = 0; i < advert.edges.size(); i++)
+        {
+            known.parent[advert.edges[i].first] = advert.edges[i].second;
+            known.cost[advert.edges[i].first] = edgeCost(advert, i);
+        }
+
+        known.seq = advert.seq;
+        known.synced = true;
+        known.dirty = true;
+        known.resyncSent = false;
+    }
+    else if (!known.synced || (advert.seq != known.seq && advert.seq != known.seq + 1))
+    {
+        // A delta was missed, the tree stays as it was until a snapshot
+        stats.intreeGaps++;
+        known.synced = false;
+
+        // Ask once per gap, the neighbor only hears it if it is an outgoing neighbor too
+        if (!known.resyncSent)
+        {
+            encodeResync(channel.wire, ID, rootedAt, outBuffer);
+            channel.writeMessage(outBuffer);
+
+            stats.resyncSent++;
+            stats.controlBytes += outBuffer.length();
+            known.resyncSent = true;
+        }
+        return;
+    }
+    else if (advert.seq == known.seq + 1)
+    {
+        // Apply the delta, a removed edge only goes if nothing replaced it
+        for (size_t i = 0; i < advert.removed.size(); i++)
+            if (known.parent[advert.removed[i].first] == (int)advert.removed[i].second)
+                known.parent[advert.removed[i].first] = -1;
+        for (size_t i = 0; i < advert.edges.size(); i++)
+        {
+            known.parent[advert.edges[i].first] = advert.edges[i].second;
+            known.cost[advert.edges[i].first] = edgeCost(advert, i);
+        }
+
+        known.seq = advert.seq;
+        known.dirty = true;
+    }
+
+    // Nothing new to merge, or the tree waits for the hold-down to end
+    if (!known.dirty)
+        return;
+    if (heldDown(rootedAt))
+    {
+        stats.heldDownRead++;
+        return;
+    }
+
+    mergeAdvert(rootedAt);
+}
+
+inline void Node::mergeAdvert(size_t rootedAt)
+{
+    NeighborAdvert &known = adverts[rootedAt];
+    known.dirty = false;
+
+    // Merge the tree as if it came whole
+    advertTree.src = rootedAt;
+    advertTree.edges.clear();
+    advertTree.costs.clear();
+    for (size_t v = 0; v < numNodes; v++)
+    {
+        if (known.parent[v] != -1)
+        {
+            advertTree.edges.push_back(make_pair(v, (size_t)known.parent[v]));
+            advertTree.costs.push_back(known.cost[v]);
+        }
+    }
+
+    computeIntree(advertTree);
+}
+
+inline void Node::computeData(const Message &data)
+{
+    // Check if it is destined to me
+    if (data.route.empty() || data.route[0] != ID)
+        return;
+
+    // Check if I am the last intermediate node
+    bool last = data.route.size() == 1;
+
+    if (data.dest == ID && last)
+    {
+        size_t flow;
+        uint64_t seq, sent;
+        if (parsePayload(data.text, data.textLen, flow, seq, sent))
+        {
+            // Generated traffic only counts for its flow
+            sink.receive(data.src, flow, seq, sent, clock(), data.textLen);
+        }
+        else
+        {
+            // Add the data to the received file
+            receivedData << "Message from " << data.src << " to " << data.dest << " : ";
+            receivedData.write(data.text, data.textLen);
+            receivedData << endl;
+        }
+
+        // Count it for the source
+        if (stats.receivedFrom.empty())
+            stats.receivedFrom.resize(numNodes, 0);
+        stats.receivedFrom[data.src]++;
+        stats.dataReceived++;
+    }
+    else
+    {
+        // Intermediate nodes the message goes on with
+        const size_t *route;
+        size_t routeLen;
+
+        if (last)
+        {
+            // The flow of a generated packet keeps it on the path of the others
+            size_t flow = 0;
+            uint64_t seq, sent;
+            parsePayload(data.text, data.textLen, flow, seq, sent);
+
+            //Pass to Neighbor
+            const vector<size_t> *found = findRouteToDest(data.dest, flowHash(data.src, data.dest, flow, ID));
+            if (found == NULL)
+            {
+                stats.droppedNoRoute++;
+                return;
+            }
+
+            route = found->data();
+            routeLen = found->size();
+        }
+        else
+        {
+            // Remove myself from the intermediate nodes
+            route = data.route.data() + 1;
+            routeLen = data.route.size() - 1;
+        }
+
+        // The first of them is the next hop, skip the encoding if it is full anyway
+        if (msg.forward.refuses(route[0]))
+        {
+            msg.forward.droppedTail++;
+            return;
+        }
+
+        string *buffer = msg.forward.acquire();
+        encodeData(channel.wire, data.src, data.dest, route, routeLen, data.text, data.textLen, *buffer);
+        msg.forward.push(route[0], buffer);
+    }
+}
+
+inline void Node::readInput()
+{
+    while (channel.readMessage(line))
+    {
+        stats.bytesRead += line.length;
+
+        // Skip anything that does not parse
+        if (!decodeMessage(channel.wire, line, numNodes, received))
+        {
+            stats.invalidRead++;
+            continue;
+        }
+
+        // Check for Hello Message
+        if (received.type == HELLO_MESSAGE)
+        {
+            stats.helloRead++;
+            computeHello(received);
+        }
+
+        // Check for Intree Message
+        if (received.type == INTREE_MESSAGE)
+        {
+            stats.intreeRead++;
+            computeIntree(received);
+        }
+
+        // Check for a Snapshot or a Delta of an Intree
+        if (received.type == SNAPSHOT_MESSAGE || received.type == DELTA_MESSAGE)
+        {
+            stats.intreeRead++;
+            computeAdvert(received);
+        }
+
+        // Check for a Resync asking for a Snapshot of my Intree
+        if (received.type == RESYNC_MESSAGE)
+        {
+            stats.intreeRead++;
+            if (received.dest == ID && intreeMode == DELTA_INTREE)
+            {
+                snapshotNow = true;
+                msg.sendIntreeNow = true;
+            }
+        }
+
+        // Check for Data Message
+        if (received.type == DATA_MESSAGE)
+        {
+            stats.dataRead++;
+            computeData(received);
+
+            // A full hop is written out before anything else is read
+            if (msg.forward.blocked())
+            {
+                stats.backpressureFlushes++;
+                drainForward();
+            }
+        }
+    }
+
+    // Nothing points into the messages read anymore
+    channel.release();
+}
+
+inline void Node::dropNeighbor(size_t i)
+{
+    cout << "Node " << ID << ": oh no! Node " << i << " got killed! Time to adapt my peers!" << endl;
+    stats.neighborDeaths++;
+
+    if (msg.sptMode == INCREMENTAL_SPT)
+    {
+        // Everything that came through it finds another neighbor
+        msg.dropNeighborTree(ID, i);
+    }
+    else if (msg.sptMode == WEIGHTED_SPT)
+    {
+        // Everything that came through it finds the next cheapest way
+        msg.dropWeightedTree(ID, i);
+    }
+    else
+    {
+        // Modify the intree of the Node
+        msg.intree.reset(i, ID);
+
+        // Remove the subtree, one step per node in it
+        msg.intree.removeSubtree(i);
+    }
+
+    // Remove it from the Incoming Neighbor
+    msg.incomingNeighbors[i] = 0;
+    if (multipath > 1)
+        hopsVia[i].clear();
+
+    // Its tree is gone, and the others may give back what went with it
+    adverts[i].synced = false;
+    if (intreeMode == DELTA_INTREE && msg.sptMode == FULL_SPT)
+        markAdvertsDirty(i);
+
+    // The intree lost the subtree
+    forgetRoutes();
+
+    // Push the intree message Immediately
+    msg.sendIntreeNow = true;
+}
+
+inline void Node::checkNeighbors()
+{
+    // Keep with the neighbors who sent the Intree
+    for (size_t i = 0; i < numNodes; i++)
+    {
+        if (msg.incomingNeighbors[i] == 1 && gotIntree[i] == false)
+        {
+            dropNeighbor(i);
+        }
+        else if (msg.incomingNeighbors[i] == 0 && gotIntree[i] == true)
+        {
+            // Add it to the incoming Neighbors
+            msg.incomingNeighbors[i] = 1;
+        }
+
+        gotIntree[i] = false;
+    }
+}
+
+inline void Node::checkLiveness()
+{
+    // The neighbors hear from me before I judge them
+    helloProtocol();
+
+    // Hold-down and forgiveness are counted in checks
+    size_t holdChecks = max(holdDownMs / keepaliveMs, 1L);
+    size_t decayChecks = max(FLAP_DECAY_MS / keepaliveMs, 1L);
+
+    for (size_t i = 0; i < numNodes; i++)
+    {
+        NeighborLiveness &n = liveness[i];
+        bool heard = gotIntree[i];
+        gotIntree[i] = false;
+
+        if (n.holdDown && --n.holdDown == 0)
+        {
+            // Back from the hold-down, with the tree its advertisements built up meanwhile
+            if (heard)
+                msg.incomingNeighbors[i] = 1;
+            if (heard && intreeMode == DELTA_INTREE && adverts[i].synced && adverts[i].dirty)
+                mergeAdvert(i);
+        }
+
+        if (heard)
+        {
+            n.missed = 0;
+
+            // Staying up long enough forgives a death
+            if (n.flaps && msg.incomingNeighbors[i] == 1 && ++n.upChecks >= decayChecks)
+            {
+                n.flaps--;
+                n.upChecks = 0;
+            }
+        }
+        else if (msg.incomingNeighbors[i] == 1 && ++n.missed >= missedLimit)
+        {
+            dropNeighbor(i);
+
+            // The first death costs nothing, every further one in a row doubles the hold-down
+            n.missed = 0;
+            n.upChecks = 0;
+            n.flaps++;
+            if (n.flaps > 1)
+                n.holdDown = holdChecks << min(n.flaps - 2, (size_t)HOLD_DOWN_DOUBLINGS);
+        }
+    }
+}
+
+inline void Node::flushPending()
+{
+    // Push the In-tree Immediately
+    if(msg.sendIntreeNow)
+    {
+        advertiseIntree();
+        msg.sendIntreeNow = false;
+    }
+
+    // Pass the Data Message to the Neighbor
+    drainForward();
+
+    // Everything of this event leaves in a single write
+    channel.flush();
+
+    // Nothing of this event needs the scratch memory anymore
+    stats.arenaBytes.set(msg.scratch.capacity());
+    msg.scratch.reset();
+}
+
+inline void Node::drainForward()
+{
+    size_t depth = msg.forward.size();
+    stats.queueDepth.set(depth);
+    if (depth > stats.queueDepthPeak)
+        stats.queueDepthPeak.set(depth);
+
+    // Only the hops with something queued are visited
+    msg.forward.drain([this](const string &message) {
+        channel.writeMessage(message);
+
+        stats.dataForwarded++;
+        stats.dataBytes += message.length();
+    });
+}
+
+inline void Node::processInputFile()
+{
+    readInput();
+
+    if (timer >= CHECK_OFFSET && ((timer - CHECK_OFFSET) % INTREE_PERIOD) == 0)
+        checkNeighbors();
+
+    flushPending();
+
+    timer++;
+}
+
+inline void Node::handleEvent(NodeEvent event)
+{
+    switch (event)
+    {
+    case HELLO_EVENT:
+        helloProtocol();
+        break;
+    case INTREE_EVENT:
+        intreeProtocol();
+        break;
+    case DATA_EVENT:
+        dataProtocol();
+        break;
+    case CHECK_EVENT:
+        checkNeighbors();
+        break;
+    case LIVENESS_EVENT:
+        checkLiveness();
+        break;
+    case TRAFFIC_EVENT:
+        trafficProtocol();
+        break;
+    case INPUT_EVENT:
+        break;
+    case STATS_EVENT:
+        exportStats();
+        break;
+    }
+
+    // Anything that came in or got queued leaves within this event
+    readInput();
+    flushPending();
+}
+
+inline void Node::exportStats()
+{
+    StatsFile file;
+    string node = "node=\"" + to_string(ID) + "\"";
+
+    file.describe("cs6390_node_messages_written_total", "counter", "Messages written to the output channel.");
+    file.sample("cs6390_node_messages_written_total", node + ",type=\"hello\"", stats.helloSent);
+    file.sample("cs6390_node_messages_written_total", node + ",type=\"intree\"", stats.intreeSent);
+    file.sample("cs6390_node_messages_written_total", node + ",type=\"snapshot\"", stats.snapshotSent);
+    file.sample("cs6390_node_messages_written_total", node + ",type=\"resync\"", stats.resyncSent);
+    file.sample("cs6390_node_messages_written_total", node + ",type=\"data\"", stats.dataSent);
+    file.sample("cs6390_node_messages_written_total", node + ",type=\"forward\"", stats.dataForwarded);
+
+    file.describe("cs6390_node_bytes_written_total", "counter", "Bytes of the messages written to the output channel.");
+    file.sample("cs6390_node_bytes_written_total", node + ",type=\"control\"", stats.controlBytes);
+    file.sample("cs6390_node_bytes_written_total", node + ",type=\"data\"", stats.dataBytes);
+
+    file.describe("cs6390_node_messages_read_total", "counter", "Messages read from the input channel.");
+    file.sample("cs6390_node_messages_read_total", node + ",type=\"hello\"", stats.helloRead);
+    file.sample("cs6390_node_messages_read_total", node + ",type=\"intree\"", stats.intreeRead);
+    file.sample("cs6390_node_messages_read_total", node + ",type=\"data\"", stats.dataRead);
+    file.sample("cs6390_node_messages_read_total", node + ",type=\"invalid\"", stats.invalidRead);
+
+    file.describe("cs6390_node_bytes_read_total", "counter", "Bytes of the messages read from the input channel.");
+    file.sample("cs6390_node_bytes_read_total", node, stats.bytesRead);
+
+    file.describe("cs6390_node_data_received_total", "counter", "Data messages delivered to this node.");
+    file.sample("cs6390_node_data_received_total", node, stats.dataReceived);
+
+    file.describe("cs6390_node_data_dropped_total", "counter", "Data messages dropped by this node.");
+    file.sample("cs6390_node_data_dropped_total", node + ",reason=\"no_route\"", stats.droppedNoRoute);
+    file.sample("cs6390_node_data_dropped_total", node + ",reason=\"queue_tail\"", msg.forward.droppedTail);
+    file.sample("cs6390_node_data_dropped_total", node + ",reason=\"queue_head\"", msg.forward.droppedHead);
+
+    file.describe("cs6390_node_channel_dropped_total", "counter", "Messages the output channel dropped after holding back too many for a full ring or segment.");
+    file.sample("cs6390_node_channel_dropped_total", node, channel.dropped);
+
+    file.describe("cs6390_node_backpressure_flushes_total", "counter", "Times a full next hop made the node write its queue out before reading on.");
+    file.sample("cs6390_node_backpressure_flushes_total", node, stats.backpressureFlushes);
+
+    file.describe("cs6390_node_forward_queue_depth", "gauge", "Data messages waiting for the neighbors at the last drain.");
+    file.sample("cs6390_node_forward_queue_depth", node, stats.queueDepth);
+
+    file.describe("cs6390_node_forward_queue_depth_peak", "gauge", "Most data messages ever waiting for the neighbors.");
+    file.sample("cs6390_node_forward_queue_depth_peak", node, stats.queueDepthPeak);
+
+    string mode = node + ",mode=\"" + sptName(msg.sptMode) + "\"";
+    file.describe("cs6390_node_spt_merges_total", "counter", "Received intrees merged with buildSPT, updateSPT or weightedSPT.");
+    file.sample("cs6390_node_spt_merges_total", mode, stats.sptMerges);
+
+    file.describe("cs6390_node_spt_merge_seconds", "histogram", "Time spent merging a received intree.");
+    file.histogram("cs6390_node_spt_merge_seconds", mode, stats.sptTime);
+
+    file.describe("cs6390_node_bfs_calls_total", "counter", "Calls of the extended BFS traversals.");
+    file.sample("cs6390_node_bfs_calls_total", node + ",function=\"extendedBFSt\"", msg.bfsTreeCalls);
+    file.sample("cs6390_node_bfs_calls_total", node + ",function=\"extendedBFSi\"", msg.bfsIntreeCalls);
+
+    file.describe("cs6390_node_route_cache_total", "counter", "Source routes taken from the cache or computed again.");
+    file.sample("cs6390_node_route_cache_total", node + ",result=\"hit\"", stats.routeHits);
+    file.sample("cs6390_node_route_cache_total", node + ",result=\"miss\"", stats.routeMisses);
+
+    file.describe("cs6390_node_intree_changes_total", "counter", "Received intrees that changed the own intree.");
+    file.sample("cs6390_node_intree_changes_total", node, stats.intreeChanges);
+
+    file.describe("cs6390_node_intree_gaps_total", "counter", "Intree deltas that did not follow the last one of their neighbor.");
+    file.sample("cs6390_node_intree_gaps_total", node, stats.intreeGaps);
+
+    file.describe("cs6390_node_neighbor_deaths_total", "counter", "Incoming neighbors found dead.");
+    file.sample("cs6390_node_neighbor_deaths_total", node, stats.neighborDeaths);
+
+    file.describe("cs6390_node_held_down_reads_total", "counter", "Messages ignored from neighbors kept out by their hold-down.");
+    file.sample("cs6390_node_held_down_reads_total", node, stats.heldDownRead);
+
+    if (!traffic.flows.empty())
+    {
+        file.describe("cs6390_node_flow_sent_packets_total", "counter", "Packets of a generated flow sent by this node.");
+        for (size_t i = 0; i < traffic.flows.size(); i++)
+            file.sample("cs6390_node_flow_sent_packets_total", node + ",flow=\"" + to_string(traffic.flows[i].flow) + "\"", traffic.flows[i].packets);
+    }
+
+    if (!sink.flows.empty())
+    {
+        file.describe("cs6390_node_flow_received_packets_total", "counter", "Packets of a generated flow received by this node.");
+        for (map<size_t, FlowReceived>::iterator it = sink.flows.begin(); it != sink.flows.end(); ++it)
+            file.sample("cs6390_node_flow_received_packets_total", node + ",flow=\"" + to_string(it->first) + "\"", it->second.packets);
+
+        file.describe("cs6390_node_flow_lost_packets_total", "counter", "Packets of a generated flow missing between those received.");
+        for (map<size_t, FlowReceived>::iterator it = sink.flows.begin(); it != sink.flows.end(); ++it)
+            file.sample("cs6390_node_flow_lost_packets_total", node + ",flow=\"" + to_string(it->first) + "\"", it->second.lost());
+
+        file.describe("cs6390_node_flow_received_bytes_total", "counter", "Payload bytes of a generated flow received by this node.");
+        for (map<size_t, FlowReceived>::iterator it = sink.flows.begin(); it != sink.flows.end(); ++it)
+            file.sample("cs6390_node_flow_received_bytes_total", node + ",flow=\"" + to_string(it->first) + "\"", it->second.bytes);
+
+        file.describe("cs6390_node_flow_latency_microseconds_total", "counter", "Sum of the one way latencies of a generated flow.");
+        for (map<size_t, FlowReceived>::iterator it = sink.flows.begin(); it != sink.flows.end(); ++it)
+            file.sample("cs6390_node_flow_latency_microseconds_total", node + ",flow=\"" + to_string(it->first) + "\"", it->second.latencySum);
+    }
+
+    file.describe("cs6390_node_arena_bytes", "gauge", "Scratch memory held by the node for its traversals and merges.");
+    file.sample("cs6390_node_arena_bytes", node, stats.arenaBytes);
+
+    file.save(to_string(ID) + "_stats.prom");
+}
+
+inline int Node::createTimer(int epollFd, long first, long period)
+{
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0)
+    {
+        cout << "Node " << ID << ": No timer" << endl;
+        exit(1);
+    }
+
+    // Arm the timer
+    struct itimerspec spec = {};
+    spec.it_value.tv_sec = first / 1000;
+    spec.it_value.tv_nsec = (first % 1000) * 1000000;
+    spec.it_interval.tv_sec = period / 1000;
+    spec.it_interval.tv_nsec = (period % 1000) * 1000000;
+    timerfd_settime(fd, 0, &spec, NULL);
+
+    // Wake up the event loop when it expires
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+
+    return fd;
+}
+
+inline void Node::armTraffic(int fd)
+{
+    // Disarmed once every flow stopped
+    struct itimerspec spec = {};
+    uint64_t at = 0;
+    if (trafficDue(at))
+    {
+        // The clock of the flows is the monotonic one, a time already past fires at once
+        spec.it_value.tv_sec = at / 1000000;
+        spec.it_value.tv_nsec = (at % 1000000) * 1000 + 1;
+    }
+
+    timerfd_settime(fd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+inline void Node::run()
+{
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+
+    // Shared memory rings cannot be watched, so they are looked at every few milliseconds, less often while idle
+    int notifyFd = -1;
+    int pollTimeout = RING_POLL_MS;
+
+    if (channel.backend == FILE_BACKEND || channel.backend == SEGMENT_BACKEND)
+    {
+        // Wake up as soon as the controller appends to the input file, segments come and go in their own directory
+        bool segments = (channel.backend == SEGMENT_BACKEND);
+        string watched = segments ? segmentDirectory(channel.inputFileName) : channel.inputFileName;
+        notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (epollFd < 0 || notifyFd < 0 || inotify_add_watch(notifyFd, watched.c_str(), segments ? IN_MODIFY | IN_CREATE : IN_MODIFY) < 0)
+        {
+            cout << "Node " << ID << ": Cannot watch input file" << endl;
+            exit(1);
+        }
+
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = notifyFd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, notifyFd, &event);
+
+        pollTimeout = -1;
+    }
+
+    // Every protocol runs once at the start, as in the first tick
+    helloProtocol();
+    intreeProtocol();
+    dataProtocol();
+    trafficProtocol();
+    readInput();
+    flushPending();
+
+    // Independent timers for every protocol
+    int helloFd = createTimer(epollFd, HELLO_PERIOD * 1000L, HELLO_PERIOD * 1000L);
+    int intreeFd = createTimer(epollFd, INTREE_PERIOD * 1000L, INTREE_PERIOD * 1000L);
+    int dataFd = createTimer(epollFd, DATA_PERIOD * 1000L, DATA_PERIOD * 1000L);
+    int doneFd = createTimer(epollFd, duration * 1000L, 0);
+    int statsFd = statsPeriod ? createTimer(epollFd, statsPeriod * 1000L, statsPeriod * 1000L) : -1;
+
+    // The flows wake the loop up when their next packet is due
+    int trafficFd = traffic.flows.empty() ? -1 : createTimer(epollFd, 0, 0);
+    if (trafficFd >= 0)
+        armTraffic(trafficFd);
+
+    // Keepalives take over from the intree to tell who is alive
+    int checkFd = keepaliveMs ? createTimer(epollFd, keepaliveMs, keepaliveMs) : createTimer(epollFd, CHECK_OFFSET * 1000L, INTREE_PERIOD * 1000L);
+
+    bool done = (duration == 0);
+    while (!done)
+    {
+        struct epoll_event events[8];
+        int n = epoll_wait(epollFd, events, 8, pollTimeout);
+
+        for (int e = 0; e < n; e++)
+        {
+            int fd = events[e].data.fd;
+
+            // Acknowledge the event
+            char buffer[4096];
+            while (read(fd, buffer, sizeof(buffer)) > 0)
+                ;
+
+            if (fd == helloFd)
+                helloProtocol();
+            else if (fd == intreeFd)
+                intreeProtocol();
+            else if (fd == dataFd)
+                dataProtocol();
+            else if (fd == checkFd && keepaliveMs)
+                checkLiveness();
+            else if (fd == checkFd)
+                checkNeighbors();
+            else if (fd == statsFd)
+                exportStats();
+            else if (fd == trafficFd)
+            {
+                trafficProtocol();
+                armTraffic(trafficFd);
+            }
+            else if (fd == doneFd)
+                done = true;
+        }
+
+        // Anything that came in or got queued leaves within this event
+        uint64_t bytesBefore = stats.bytesRead;
+        readInput();
+        flushPending();
+
+        // An idle ring backs off, one that had something is looked at again soon
+        if (channel.backend == SHM_BACKEND)
+            pollTimeout = (stats.bytesRead != bytesBefore) ? RING_POLL_MS : min(pollTimeout * 2, RING_MAX_POLL_MS);
+    }
+
+    close(helloFd);
+    close(intreeFd);
+    close(dataFd);
+    close(checkFd);
+    close(doneFd);
+    if (statsFd >= 0)
+    {
+        // Leave the final counters behind
+        exportStats();
+        close(statsFd);
+    }
+    if (trafficFd >= 0)
+        close(trafficFd);
+    reportFlows();
+    if (notifyFd >= 0)
+        close(notifyFd);
+    close(epollFd);
+}
+
+#endif
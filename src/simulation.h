@@ -0,0 +1,455 @@
+/*
+ *  Runs the nodes and the controller as objects of a single process,
+ *  driven by a discrete event scheduler on a virtual clock.
+ *  Copyright (C) 2021 Sourabh J Choure
+ *
+ *  I promise that the work presented below is of my own.
+ *
+ *  To make it FOSS Compliant, this software is free to use.
+ */
+
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+// STL
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <vector>
+// SL
+#include <stdint.h>
+// Programs
+#include "node.h"
+#include "controller.h"
+
+using namespace std;
+
+// Virtual time is kept in microseconds
+#define SECOND 1000000ULL
+
+// Time the controller sleeps before it starts, as in its main
+#define CONTROLLER_DELAY SECOND
+
+// How the nodes took a topology event, measured by the simulation
+struct Reconvergence
+{
+    // Lines of the events applied together, and the virtual time they were applied
+    string event;
+    uint64_t applied;
+
+    // Virtual time of the last intree change or neighbor death before the next event, and the number of them
+    uint64_t lastChange;
+    size_t changes;
+};
+
+// A node as it would be started from a scenario script
+struct NodeSpec
+{
+    size_t ID;
+    size_t duration;
+    int dest;
+    string message;
+};
+
+class Simulation
+{
+public:
+    Simulation(const NodeOptions &options) : options(options), controllerDuration(0), controller(NULL), now(0)
+    {
+        this->options.backend = MEMORY_BACKEND;
+    };
+    virtual ~Simulation();
+
+    // Settings shared by all the nodes
+    NodeOptions options;
+
+    // Nodes to start at time zero
+    vector<NodeSpec> specs;
+
+    // Seconds the controller runs for, 0 if there is none
+    size_t controllerDuration;
+
+    // Microseconds between two passes of the controller, once a second as in its polling loop
+    uint64_t passPeriod = SECOND;
+
+    // Print when a program is done, as the programs do
+    bool verbose = true;
+
+    // Wall clock seconds spent in the passes of the controller
+    double controllerTime = 0;
+
+    // Timed changes of the topology the controller applies, none if empty
+    string eventsFile;
+
+    // Reconvergence after every topology event, in the order they were applied
+    vector<Reconvergence> reconvergence;
+
+    // What every link of the controller does unless the topology says otherwise
+    LinkModel link;
+
+    // Read the programs of a scenario, one "controller D" or "node ID D dest message" per line
+    bool load(const string &);
+
+    // Run every event in virtual time order
+    void run();
+
+    // Virtual time of the current event
+    uint64_t time() { return now; };
+
+protected:
+    // Running nodes, NULL once they stopped
+    vector<Node *> nodes;
+
+    // The controller, once it started
+    Controller *controller;
+
+    // Called after a node handled an event
+    virtual void nodeHandled(size_t){};
+
+    // Called before a node stops
+    virtual void nodeStopping(size_t){};
+
+private:
+    // What happens at an event, in the order they run at the same time
+    enum EventType
+    {
+        NODE_STOP,
+        NODE_HELLO,
+        NODE_INTREE,
+        NODE_DATA,
+        NODE_CHECK,
+        NODE_LIVENESS,
+        NODE_TRAFFIC,
+        NODE_STATS,
+        CONTROLLER_START,
+        CONTROLLER_EVENTS,
+        CONTROLLER_DELIVER,
+        CONTROLLER_PASS,
+        NODE_INPUT
+    };
+
+    struct Event
+    {
+        uint64_t time;
+        EventType type;
+        size_t who;
+
+        bool operator>(const Event &e) const
+        {
+            if (time != e.time)
+                return time > e.time;
+            if (type != e.type)
+                return type > e.type;
+            return who > e.who;
+        };
+    };
+
+    // Pending events, earliest first
+    priority_queue<Event, vector<Event>, greater<Event>> events;
+
+    // Input channel of every node, to know who the controller wrote to
+    vector<MemoryChannel *> inputs;
+
+    // Passes the controller still has to make
+    size_t controllerPasses;
+
+    // Current virtual time
+    uint64_t now;
+
+    // Virtual time the controller started
+    uint64_t controllerStart = 0;
+
+    // Intree changes and neighbor deaths of every node when it was last looked at
+    vector<size_t> intreeChangesSeen;
+
+    // Apply the topology events due now and schedule the next one
+    void topologyEvents();
+
+    // Virtual time of the next delivery over the emulated links, 0 if none is scheduled
+    uint64_t deliverAt = 0;
+
+    // Schedule the delivery of the next message on the way over an emulated link
+    void heldMessages();
+
+    // Wake up the nodes that got something, as inotify would
+    void wakeNodes();
+
+    // Add an event
+    void schedule(uint64_t, EventType, size_t);
+
+    // Let a node handle an event and schedule its next one
+    void nodeEvent(const Event &, Node::NodeEvent, uint64_t);
+};
+
+inline Simulation::~Simulation()
+{
+    for (size_t i = 0; i < nodes.size(); i++)
+        delete nodes[i];
+
+    delete controller;
+}
+
+inline bool Simulation::load(const string &fileName)
+{
+    ifstream scenario(fileName.c_str());
+    if (scenario.fail())
+        return false;
+
+    string line;
+    while (getline(scenario, line))
+    {
+        istringstream words(line);
+        string program;
+        words >> program;
+
+        if (program == "controller")
+        {
+            words >> controllerDuration;
+        }
+        else if (program == "node")
+        {
+            NodeSpec spec;
+            words >> spec.ID >> spec.duration >> spec.dest;
+            if (words.fail())
+                return false;
+
+            // The message is the rest of the line
+            getline(words >> ws, spec.message);
+            specs.push_back(spec);
+        }
+        else if (program != "" && program[0] != '#')
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+inline void Simulation::schedule(uint64_t at, EventType type, size_t who)
+{
+    Event event = {at, type, who};
+    events.push(event);
+}
+
+inline void Simulation::nodeEvent(const Event &event, Node::NodeEvent what, uint64_t period)
+{
+    nodes[event.who]->handleEvent(what);
+    nodeHandled(event.who);
+
+    // Every intree change after a topology event counts toward its reconvergence, a dropped neighbor too
+    size_t changes = nodes[event.who]->stats.intreeChanges + nodes[event.who]->stats.neighborDeaths;
+    if (changes != intreeChangesSeen[event.who])
+    {
+        intreeChangesSeen[event.who] = changes;
+        if (!reconvergence.empty())
+        {
+            reconvergence.back().lastChange = now;
+            reconvergence.back().changes++;
+        }
+    }
+
+    if (period)
+        schedule(now + period, event.type, event.who);
+}
+
+inline void Simulation::topologyEvents()
+{
+    // Events at the same time are measured together
+    size_t applied = controller->applyEvents();
+    if (applied)
+    {
+        Reconvergence taken = {controller->lastEvents(applied), now, now, 0};
+        reconvergence.push_back(taken);
+    }
+
+    // Only while the controller runs
+    uint64_t due = 0;
+    if (controller->eventDue(due) && controllerPasses)
+        schedule(max(due, now), CONTROLLER_EVENTS, 0);
+}
+
+inline void Simulation::heldMessages()
+{
+    // Only while the controller runs, and once for the earliest message
+    uint64_t due = 0;
+    if (!controller->heldDue(due) || !controllerPasses)
+        return;
+
+    due = max(due, now);
+    if (deliverAt && deliverAt <= due)
+        return;
+
+    deliverAt = due;
+    schedule(due, CONTROLLER_DELIVER, 0);
+}
+
+inline void Simulation::wakeNodes()
+{
+    for (size_t i = 0; i < nodes.size(); i++)
+        if (nodes[i] != NULL && !inputs[i]->empty())
+            schedule(now, NODE_INPUT, i);
+}
+
+inline void Simulation::run()
+{
+    // Start every node at time zero, as the scenario scripts do
+    nodes.assign(specs.size(), NULL);
+    inputs.assign(specs.size(), NULL);
+    intreeChangesSeen.assign(specs.size(), 0);
+    for (size_t i = 0; i < specs.size(); i++)
+    {
+        nodes[i] = new Node(specs[i].ID, specs[i].duration, specs[i].dest, specs[i].message, options);
+        inputs[i] = &memoryChannel("input_" + to_string(specs[i].ID));
+
+        // The flows run on virtual time
+        nodes[i]->clock = [this]() { return now; };
+
+        // The same timers as the event loop of a node
+        schedule(0, NODE_HELLO, i);
+        schedule(0, NODE_INTREE, i);
+        schedule(0, NODE_DATA, i);
+        if (options.keepaliveMs)
+            schedule(options.keepaliveMs * 1000, NODE_LIVENESS, i);
+        else
+            schedule(CHECK_OFFSET * SECOND, NODE_CHECK, i);
+        if (options.statsPeriod)
+            schedule(options.statsPeriod * SECOND, NODE_STATS, i);
+        schedule(specs[i].duration * SECOND, NODE_STOP, i);
+
+        uint64_t due = 0;
+        if (nodes[i]->trafficDue(due))
+            schedule(0, NODE_TRAFFIC, i);
+    }
+
+    if (controllerDuration)
+        schedule(CONTROLLER_DELAY, CONTROLLER_START, 0);
+
+    while (!events.empty())
+    {
+        Event event = events.top();
+        events.pop();
+        now = event.time;
+
+        // Events of a stopped node are dropped
+        bool forNode = (event.type != CONTROLLER_START && event.type != CONTROLLER_EVENTS && event.type != CONTROLLER_DELIVER && event.type != CONTROLLER_PASS);
+        if (forNode && nodes[event.who] == NULL)
+            continue;
+
+        switch (event.type)
+        {
+        case NODE_STOP:
+            nodeStopping(event.who);
+            if (verbose)
+                cout << "Node " << nodes[event.who]->ID << " Done" << endl;
+            nodes[event.who]->reportFlows();
+            delete nodes[event.who];
+            nodes[event.who] = NULL;
+            break;
+
+        case NODE_HELLO:
+            nodeEvent(event, Node::HELLO_EVENT, HELLO_PERIOD * SECOND);
+            break;
+
+        case NODE_INTREE:
+            nodeEvent(event, Node::INTREE_EVENT, INTREE_PERIOD * SECOND);
+            break;
+
+        case NODE_DATA:
+            nodeEvent(event, Node::DATA_EVENT, DATA_PERIOD * SECOND);
+            break;
+
+        case NODE_CHECK:
+            nodeEvent(event, Node::CHECK_EVENT, INTREE_PERIOD * SECOND);
+            break;
+
+        case NODE_LIVENESS:
+            nodeEvent(event, Node::LIVENESS_EVENT, options.keepaliveMs * 1000);
+            break;
+
+        case NODE_TRAFFIC:
+        {
+            nodeEvent(event, Node::TRAFFIC_EVENT, 0);
+
+            // The next packet of any flow
+            uint64_t due = 0;
+            if (nodes[event.who]->trafficDue(due))
+                schedule(max(due, now), NODE_TRAFFIC, event.who);
+            break;
+        }
+
+        case NODE_STATS:
+            nodeEvent(event, Node::STATS_EVENT, options.statsPeriod * SECOND);
+            break;
+
+        case NODE_INPUT:
+            nodeEvent(event, Node::INPUT_EVENT, 0);
+            break;
+
+        case CONTROLLER_START:
+        {
+            ControllerOptions settings;
+            settings.numNodes = options.numNodes;
+            settings.backend = MEMORY_BACKEND;
+            settings.wire = options.wire;
+            settings.eventsFile = eventsFile;
+            settings.link = link;
+
+            controller = new Controller(controllerDuration, settings);
+            controllerStart = now;
+            controllerPasses = controllerDuration * SECOND / passPeriod;
+            schedule(now, CONTROLLER_PASS, 0);
+
+            // The topology events run on virtual time from now
+            controller->clock = [this]() { return now; };
+            topologyEvents();
+            break;
+        }
+
+        case CONTROLLER_EVENTS:
+            topologyEvents();
+            break;
+
+        case CONTROLLER_DELIVER:
+            // A later delivery may have been scheduled before this one
+            if (deliverAt == now)
+                deliverAt = 0;
+
+            if (controller->deliverHeld())
+                wakeNodes();
+            heldMessages();
+            break;
+
+        case CONTROLLER_PASS:
+        {
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            controller->sendToNeighborsData();
+            controllerTime += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+            wakeNodes();
+
+            if (--controllerPasses)
+                schedule(now + passPeriod, CONTROLLER_PASS, 0);
+            else if (verbose)
+                cout << "Controller Done" << endl;
+
+            // What the pass sent over the emulated links
+            heldMessages();
+            break;
+        }
+        }
+    }
+
+    // How long the intrees kept changing after every topology event
+    for (size_t k = 0; k < reconvergence.size() && verbose; k++)
+    {
+        const Reconvergence &taken = reconvergence[k];
+        cout << "Reconvergence: " << taken.event << " at " << double(taken.applied - controllerStart) / SECOND << " s took "
+             << double(taken.lastChange - taken.applied) / SECOND << " s and " << taken.changes << " intree changes" << endl;
+    }
+}
+
+#endif
@@ -0,0 +1,185 @@
+/*
+ *  Runs a whole scenario of nodes and the controller inside one
+ *  process on a virtual clock, so long runs finish in seconds.
+ *  Copyright (C) 2021 Sourabh J Choure
+ *
+ *  I promise that the work presented below is of my own.
+ *
+ *  To make it FOSS Compliant, this software is free to use.
+ */
+
+// Unix
+#include <getopt.h>
+#include <sys/resource.h>
+// Simulation
+#include "simulation.h"
+
+using namespace std;
+
+int main(int argc, char *argv[])
+{
+    // Check for the optional flags
+    NodeOptions options;
+    long passMs = 1000;
+    const char *flowsFile = NULL;
+    const char *eventsFile = NULL;
+    LinkModel link;
+    static struct option longOptions[] = {
+        {"nodes", required_argument, NULL, 'n'},
+        {"spt", required_argument, NULL, 's'},
+        {"intree", required_argument, NULL, 'i'},
+        {"wire", required_argument, NULL, 'w'},
+        {"stats", required_argument, NULL, 'p'},
+        {"queue", required_argument, NULL, 'q'},
+        {"queue-policy", required_argument, NULL, 'Q'},
+        {"keepalive-ms", required_argument, NULL, 'k'},
+        {"missed", required_argument, NULL, 'm'},
+        {"hold-down-ms", required_argument, NULL, 'h'},
+        {"flows", required_argument, NULL, 'F'},
+        {"multipath", required_argument, NULL, 'M'},
+        {"events", required_argument, NULL, 'E'},
+        {"pass-ms", required_argument, NULL, 'P'},
+        {"link", required_argument, NULL, 'L'},
+        {NULL, 0, NULL, 0}};
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "+n:s:i:w:p:q:Q:k:m:h:P:F:M:E:L:", longOptions, NULL)) != -1)
+    {
+        bool valid = true;
+        switch (opt)
+        {
+        case 'n':
+            options.numNodes = strtol(optarg, NULL, 10);
+            valid = (long)options.numNodes > 0;
+            break;
+        case 's':
+            if (strcmp(optarg, "full") == 0)
+                options.spt = FULL_SPT;
+            else if (strcmp(optarg, "incremental") == 0)
+                options.spt = INCREMENTAL_SPT;
+            else if (strcmp(optarg, "weighted") == 0)
+                options.spt = WEIGHTED_SPT;
+            else
+                valid = false;
+            break;
+        case 'i':
+            if (strcmp(optarg, "full") == 0)
+                options.intree = FULL_INTREE;
+            else if (strcmp(optarg, "delta") == 0)
+                options.intree = DELTA_INTREE;
+            else
+                valid = false;
+            break;
+        case 'w':
+            valid = parseWire(optarg, options.wire);
+            break;
+        case 'p':
+            options.statsPeriod = strtol(optarg, NULL, 10);
+            valid = (long)options.statsPeriod > 0;
+            break;
+        case 'q':
+            options.queueLimit = strtol(optarg, NULL, 10);
+            valid = (long)options.queueLimit > 0;
+            break;
+        case 'Q':
+            valid = parseQueuePolicy(optarg, options.queuePolicy);
+            break;
+        case 'M':
+            options.multipath = strtol(optarg, NULL, 10);
+            valid = (long)options.multipath > 0;
+            break;
+        case 'k':
+            options.keepaliveMs = strtol(optarg, NULL, 10);
+            valid = options.keepaliveMs > 0;
+            break;
+        case 'm':
+            options.missedLimit = strtol(optarg, NULL, 10);
+            valid = (long)options.missedLimit > 0;
+            break;
+        case 'h':
+            options.holdDownMs = strtol(optarg, NULL, 10);
+            valid = options.holdDownMs > 0;
+            break;
+        case 'F':
+            flowsFile = optarg;
+            break;
+        case 'E':
+            eventsFile = optarg;
+            break;
+        case 'L':
+            valid = parseLinkModel(optarg, link);
+            break;
+        case 'P':
+            passMs = strtol(optarg, NULL, 10);
+            valid = passMs > 0;
+            break;
+        default:
+            valid = false;
+        }
+
+        if (!valid)
+        {
+            cout << "Usage: simulator [--nodes N] [--spt full|incremental|weighted] [--intree full|delta] [--wire text|binary] [--stats SECONDS] [--queue N] [--queue-policy tail|head|backpressure] [--keepalive-ms MS] [--missed N] [--hold-down-ms MS] [--pass-ms MS] [--flows FILE] [--multipath K] [--events FILE] [--link delay=MS,bw=KBPS,queue=N,loss=P] Scenario" << endl;
+            return -1;
+        }
+    }
+
+    // The flows name nodes, so they are read once the number of nodes is known
+    if (flowsFile && !loadFlows(flowsFile, options.numNodes, options.flows))
+    {
+        cout << "Cannot read the flows " << flowsFile << endl;
+        return -1;
+    }
+
+    //Check number of arguments
+    if (argc - optind != 1)
+    {
+        cout << "too " << (argc - optind < 1 ? "few " : "many ") << "arguments passed" << endl;
+        cout << "Requires: Scenario" << endl;
+        return -1;
+    }
+
+    Simulation simulation(options);
+    simulation.passPeriod = passMs * 1000;
+    if (eventsFile)
+        simulation.eventsFile = eventsFile;
+    simulation.link = link;
+    if (!simulation.load(argv[optind]))
+    {
+        cout << "Cannot read the scenario " << argv[optind] << endl;
+        return -1;
+    }
+
+    // Check that the nodes belong to the network, each one only once
+    vector<bool> seen(options.numNodes, false);
+    for (size_t i = 0; i < simulation.specs.size(); i++)
+    {
+        const NodeSpec &spec = simulation.specs[i];
+        if (spec.ID >= options.numNodes || spec.dest < -1 || spec.dest >= (long)options.numNodes)
+        {
+            cout << "ID and Destination must be less than " << options.numNodes << endl;
+            return -1;
+        }
+
+        // Two nodes with one ID would share and split one input
+        if (seen[spec.ID])
+        {
+            cout << "Node " << spec.ID << " appears more than once in the scenario" << endl;
+            return -1;
+        }
+        seen[spec.ID] = true;
+    }
+
+    // The received files stay open for every node at once
+    struct rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0)
+    {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+
+    // Run every node and the controller until the last event
+    simulation.run();
+
+    return 0;
+}
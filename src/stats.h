@@ -0,0 +1,163 @@
+/*
+ *  Counters and histograms of the nodes and the controller, written
+ *  out as text files in the Prometheus exposition format.
+ *  Copyright (C) 2021 Sourabh J Choure
+ *
+ *  I promise that the work presented below is of my own.
+ *
+ *  To make it FOSS Compliant, this software is free to use.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+// STL
+#include <atomic>
+#include <fstream>
+#include <string>
+// SL
+#include <cstdio>
+#include <stdint.h>
+// Unix
+#include <time.h>
+
+using namespace std;
+
+// Upper bounds of the histogram buckets in nanoseconds, four times apart from 1us to 1s
+#define HISTOGRAM_BUCKETS 11
+#define HISTOGRAM_FIRST_NS 1000ULL
+
+// A counter or gauge with a single writer, read at any time by others
+class Counter
+{
+public:
+    Counter() : value(0){};
+
+    // Without a lock or a locked instruction, as there is only one writer
+    void add(uint64_t n) { value.store(value.load(memory_order_relaxed) + n, memory_order_relaxed); };
+    void set(uint64_t n) { value.store(n, memory_order_relaxed); };
+
+    Counter &operator++(int)
+    {
+        add(1);
+        return *this;
+    };
+    Counter &operator+=(uint64_t n)
+    {
+        add(n);
+        return *this;
+    };
+    operator uint64_t() const { return value.load(memory_order_relaxed); };
+
+private:
+    atomic<uint64_t> value;
+};
+
+// Distribution of durations, with a single writer
+class Histogram
+{
+public:
+    // Count a duration
+    void observe(uint64_t ns);
+
+    // Number of durations in bucket k, the last one has no upper bound
+    Counter buckets[HISTOGRAM_BUCKETS + 1];
+
+    // Total of the durations, and how many there were
+    Counter sumNs;
+    Counter count;
+};
+
+inline void Histogram::observe(uint64_t ns)
+{
+    size_t k = 0;
+    for (uint64_t bound = HISTOGRAM_FIRST_NS; k < HISTOGRAM_BUCKETS && ns > bound; bound *= 4)
+        k++;
+
+    buckets[k]++;
+    sumNs += ns;
+    count++;
+}
+
+// Nanoseconds on the monotonic clock
+inline uint64_t monotonicNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// Text of a stats file in the Prometheus exposition format
+class StatsFile
+{
+public:
+    // Start a metric with its help text and type
+    void describe(const char *name, const char *type, const char *help);
+
+    // One sample of a counter or gauge, labels as `a="x",b="y"`
+    void sample(const char *name, const string &labels, uint64_t value);
+
+    // Every series of a histogram
+    void histogram(const char *name, const string &labels, const Histogram &h);
+
+    // Replace the file at once, so a reader never sees half of it
+    bool save(const string &fileName);
+
+private:
+    string text;
+};
+
+inline void StatsFile::describe(const char *name, const char *type, const char *help)
+{
+    text += string("# HELP ") + name + " " + help + "\n";
+    text += string("# TYPE ") + name + " " + type + "\n";
+}
+
+inline void StatsFile::sample(const char *name, const string &labels, uint64_t value)
+{
+    text += name;
+    if (!labels.empty())
+        text += "{" + labels + "}";
+    text += " " + to_string(value) + "\n";
+}
+
+inline void StatsFile::histogram(const char *name, const string &labels, const Histogram &h)
+{
+    // The buckets are cumulative
+    uint64_t cumulative = 0;
+    uint64_t bound = HISTOGRAM_FIRST_NS;
+    char le[32];
+    string prefix = labels.empty() ? "" : labels + ",";
+
+    for (size_t k = 0; k <= HISTOGRAM_BUCKETS; k++, bound *= 4)
+    {
+        cumulative += h.buckets[k];
+        if (k < HISTOGRAM_BUCKETS)
+            snprintf(le, sizeof(le), "%.9g", bound / 1e9);
+        else
+            snprintf(le, sizeof(le), "+Inf");
+
+        text += string(name) + "_bucket{" + prefix + "le=\"" + le + "\"} " + to_string(cumulative) + "\n";
+    }
+
+    char sum[32];
+    snprintf(sum, sizeof(sum), "%.9f", h.sumNs / 1e9);
+    string suffix = labels.empty() ? " " : "{" + labels + "} ";
+    text += string(name) + "_sum" + suffix + sum + "\n";
+    text += string(name) + "_count" + suffix + to_string(uint64_t(h.count)) + "\n";
+}
+
+inline bool StatsFile::save(const string &fileName)
+{
+    string tmpName = fileName + ".tmp";
+    ofstream file(tmpName.c_str(), ios::out | ios::trunc);
+    file << text;
+    file.close();
+
+    if (file.fail())
+        return false;
+
+    return rename(tmpName.c_str(), fileName.c_str()) == 0;
+}
+
+#endif
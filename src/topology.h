@@ -0,0 +1,155 @@
+/*
+ *  Generators of the topology file for networks of any size, used
+ *  to benchmark the nodes and the controller.
+ *  Copyright (C) 2021 Sourabh J Choure
+ *
+ *  I promise that the work presented below is of my own.
+ *
+ *  To make it FOSS Compliant, this software is free to use.
+ */
+
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+// STL
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+// SL
+#include <cstring>
+
+using namespace std;
+
+enum TopologyKind
+{
+    // Every node linked both ways to the next one
+    RING_TOPOLOGY,
+    // Square grid, linked both ways to the four neighbors
+    GRID_TOPOLOGY,
+    // Random tree of two way links, plus random two way links
+    RANDOM_TOPOLOGY,
+    // Preferential attachment, new nodes link both ways to popular ones
+    SCALE_FREE_TOPOLOGY,
+    // One way ring, plus random one way chords
+    UNIDIRECTIONAL_TOPOLOGY
+};
+
+// Name of every kind, in the order of TopologyKind
+static const char *const topologyNames[] = {"ring", "grid", "random", "scalefree", "unidirectional"};
+#define NUM_TOPOLOGIES 5
+
+// Links per node added by the random and scale free generators
+#define EXTRA_LINKS 2
+
+// Directed links (from to), without duplicates and in order
+typedef set<pair<size_t, size_t>> Links;
+
+// Add a link, and its reverse when it goes both ways
+inline void addLink(Links &links, size_t from, size_t to, bool both)
+{
+    if (from == to)
+        return;
+
+    links.insert(make_pair(from, to));
+    if (both)
+        links.insert(make_pair(to, from));
+}
+
+inline Links makeTopology(TopologyKind kind, size_t numNodes, unsigned seed)
+{
+    Links links;
+    mt19937 generator(seed);
+
+    switch (kind)
+    {
+    case RING_TOPOLOGY:
+        for (size_t i = 0; i < numNodes; i++)
+            addLink(links, i, (i + 1) % numNodes, true);
+        break;
+
+    case GRID_TOPOLOGY:
+    {
+        size_t side = ceil(sqrt(double(numNodes)));
+        for (size_t i = 0; i < numNodes; i++)
+        {
+            // Right and down
+            if ((i + 1) % side && i + 1 < numNodes)
+                addLink(links, i, i + 1, true);
+            if (i + side < numNodes)
+                addLink(links, i, i + side, true);
+        }
+        break;
+    }
+
+    case RANDOM_TOPOLOGY:
+        // A random tree keeps everyone connected
+        for (size_t i = 1; i < numNodes; i++)
+            addLink(links, i, generator() % i, true);
+
+        for (size_t k = 0; numNodes > 1 && k < numNodes * EXTRA_LINKS / 2; k++)
+            addLink(links, generator() % numNodes, generator() % numNodes, true);
+        break;
+
+    case SCALE_FREE_TOPOLOGY:
+    {
+        // Every end of every link, so a node is picked as often as its degree
+        vector<size_t> ends;
+        for (size_t i = 1; i < numNodes; i++)
+        {
+            for (size_t k = 0; k < EXTRA_LINKS; k++)
+            {
+                size_t to = ends.empty() ? 0 : ends[generator() % ends.size()];
+                if (to == i || links.count(make_pair(i, to)))
+                    continue;
+
+                addLink(links, i, to, true);
+                ends.push_back(i);
+                ends.push_back(to);
+            }
+        }
+        break;
+    }
+
+    case UNIDIRECTIONAL_TOPOLOGY:
+        // The one way ring keeps everyone reachable
+        for (size_t i = 0; i < numNodes; i++)
+            addLink(links, i, (i + 1) % numNodes, false);
+
+        for (size_t k = 0; numNodes > 1 && k < numNodes; k++)
+            addLink(links, generator() % numNodes, generator() % numNodes, false);
+        break;
+    }
+
+    return links;
+}
+
+// Parse the name of a topology given on the command line
+inline bool parseTopology(const char *name, TopologyKind &kind)
+{
+    for (int k = 0; k < NUM_TOPOLOGIES; k++)
+    {
+        if (strcmp(name, topologyNames[k]) == 0)
+        {
+            kind = TopologyKind(k);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Write the links in the format the controller reads
+inline bool writeTopology(const Links &links, const string &fileName)
+{
+    ofstream file(fileName.c_str());
+    for (Links::const_iterator link = links.begin(); link != links.end(); link++)
+        file << link->first << " " << link->second << "\n";
+
+    return !file.fail();
+}
+
+#endif
@@ -0,0 +1,385 @@
+/*
+ *  Flows of generated data messages to load the nodes and the
+ *  controller, and the goodput, loss and latency seen by the receivers.
+ *  Copyright (C) 2021 Sourabh J Choure
+ *
+ *  I promise that the work presented below is of my own.
+ *
+ *  To make it FOSS Compliant, this software is free to use.
+ */
+
+#ifndef TRAFFIC_H
+#define TRAFFIC_H
+
+// STL
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+// SL
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+
+using namespace std;
+
+// Times of the traffic are kept in microseconds
+#define TRAFFIC_SECOND 1000000ULL
+
+// Packets a node sends at most in one go when it fell behind
+#define TRAFFIC_BURST 1024
+
+// Largest payload a flow may ask for
+#define TRAFFIC_MAX_SIZE 65536
+
+// How the payload size of a flow is drawn
+enum SizeKind
+{
+    // Always sizeMin
+    FIXED_SIZE,
+    // Uniform between sizeMin and sizeMax
+    UNIFORM_SIZE,
+    // Exponential with a mean of sizeMin
+    EXPONENTIAL_SIZE
+};
+
+// A line of the flow file
+struct FlowSpec
+{
+    size_t src;
+    size_t dest;
+
+    // Packets per second
+    double rate;
+
+    // Payload size in bytes
+    SizeKind sizeKind;
+    size_t sizeMin;
+    size_t sizeMax;
+
+    // Microseconds after the start of the source
+    uint64_t start;
+    uint64_t stop;
+};
+
+// Read a size given as "N", "A-B" or "~M"
+inline bool parseSize(const string &word, FlowSpec &flow)
+{
+    char *end;
+    if (word[0] == '~')
+    {
+        flow.sizeKind = EXPONENTIAL_SIZE;
+        flow.sizeMin = strtoul(word.c_str() + 1, &end, 10);
+        flow.sizeMax = TRAFFIC_MAX_SIZE;
+    }
+    else
+    {
+        flow.sizeMin = strtoul(word.c_str(), &end, 10);
+        flow.sizeKind = (*end == '-') ? UNIFORM_SIZE : FIXED_SIZE;
+        flow.sizeMax = (*end == '-') ? strtoul(end + 1, &end, 10) : flow.sizeMin;
+    }
+
+    return *end == '\0' && flow.sizeMin > 0 && flow.sizeMin <= flow.sizeMax && flow.sizeMax <= TRAFFIC_MAX_SIZE;
+}
+
+// Read the flows, one "src dest rate size start stop" per line, with the times in seconds
+inline bool loadFlows(const string &fileName, size_t numNodes, vector<FlowSpec> &flows)
+{
+    ifstream file(fileName.c_str());
+    if (file.fail())
+        return false;
+
+    string line;
+    while (getline(file, line))
+    {
+        // Skip comments and empty lines
+        istringstream words(line);
+        string first;
+        if (!(words >> first) || first[0] == '#')
+            continue;
+
+        FlowSpec flow;
+        string size;
+        double start, stop;
+        flow.src = strtoul(first.c_str(), NULL, 10);
+        words >> flow.dest >> flow.rate >> size >> start >> stop;
+
+        if (words.fail() || flow.src >= numNodes || flow.dest >= numNodes || flow.src == flow.dest)
+            return false;
+        if (flow.rate <= 0 || start < 0 || stop <= start || !parseSize(size, flow))
+            return false;
+
+        flow.start = start * TRAFFIC_SECOND;
+        flow.stop = stop * TRAFFIC_SECOND;
+        flows.push_back(flow);
+    }
+
+    return true;
+}
+
+// Payload "#flow seq time " padded with dots to its size
+inline void makePayload(size_t flow, uint64_t seq, uint64_t time, size_t size, string &out)
+{
+    out.clear();
+    out += '#';
+    out += to_string(flow);
+    out += ' ';
+    out += to_string(seq);
+    out += ' ';
+    out += to_string(time);
+    out += ' ';
+
+    if (out.length() < size)
+        out.append(size - out.length(), '.');
+}
+
+// Read the header of a generated payload, false for any other text
+inline bool parsePayload(const char *text, size_t length, size_t &flow, uint64_t &seq, uint64_t &time)
+{
+    const char *p = text;
+    const char *end = text + length;
+    if (p == end || *p++ != '#')
+        return false;
+
+    uint64_t fields[3];
+    for (int i = 0; i < 3; i++)
+    {
+        if (p == end || *p < '0' || *p > '9')
+            return false;
+
+        for (fields[i] = 0; p < end && *p >= '0' && *p <= '9'; p++)
+            fields[i] = fields[i] * 10 + (*p - '0');
+
+        if (p == end || *p++ != ' ')
+            return false;
+    }
+
+    flow = fields[0];
+    seq = fields[1];
+    time = fields[2];
+    return true;
+}
+
+// What a source did with one of its flows
+struct FlowSent
+{
+    // Flow number, its line among the flows of the file
+    size_t flow;
+    FlowSpec spec;
+
+    // Time the next packet is due
+    uint64_t due;
+
+    // Packets and payload bytes sent, and packets without a route
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    uint64_t noRoute = 0;
+};
+
+// What a destination saw of one flow
+struct FlowReceived
+{
+    size_t src = 0;
+
+    // Packets and payload bytes received, and one past the highest sequence number
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    uint64_t expected = 0;
+
+    // Arrival of the first and the last packet
+    uint64_t first = 0;
+    uint64_t last = 0;
+
+    // One way latency
+    uint64_t latencySum = 0;
+    uint64_t latencyMax = 0;
+
+    // Packets the receiver knows were lost, those it never saw at the end are only known to the source
+    uint64_t lost() const { return expected - min(expected, packets); };
+
+    // Payload bits per second between the first and the last arrival
+    double goodput() const { return last > first ? bytes * 8.0 * TRAFFIC_SECOND / (last - first) : 0; };
+};
+
+class TrafficGenerator
+{
+public:
+    // Flows of the source, numbered by their line among all the flows
+    vector<FlowSent> flows;
+
+    // Take the flows of a source, whose ID seeds the payload sizes
+    void setup(const vector<FlowSpec> &all, size_t src);
+
+    // Time the next packet is due, false once every flow stopped
+    bool due(uint64_t &at) const;
+
+    // Hand every packet due by now to send with its flow, false from send means there was no route
+    template <class Send>
+    void run(uint64_t now, Send send);
+
+private:
+    // Start of the source, set by the first run
+    uint64_t origin = 0;
+    bool started = false;
+
+    // Flow the next run starts at, moved past the flow that used up the last burst
+    size_t nextFlow = 0;
+
+    mt19937 generator;
+
+    // Payload being built, reused to keep its buffer
+    string payload;
+
+    // Draw the payload size of a flow
+    size_t drawSize(const FlowSpec &);
+};
+
+inline void TrafficGenerator::setup(const vector<FlowSpec> &all, size_t src)
+{
+    generator.seed(src + 1);
+
+    for (size_t i = 0; i < all.size(); i++)
+    {
+        if (all[i].src != src)
+            continue;
+
+        FlowSent sent;
+        sent.flow = i;
+        sent.spec = all[i];
+        sent.due = all[i].start;
+        flows.push_back(sent);
+    }
+}
+
+inline bool TrafficGenerator::due(uint64_t &at) const
+{
+    bool found = false;
+    for (size_t i = 0; i < flows.size(); i++)
+    {
+        if (flows[i].due < flows[i].spec.stop && (!found || origin + flows[i].due < at))
+        {
+            // Times of the flows count from the first run
+            at = origin + flows[i].due;
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+inline size_t TrafficGenerator::drawSize(const FlowSpec &spec)
+{
+    if (spec.sizeKind == UNIFORM_SIZE)
+        return uniform_int_distribution<size_t>(spec.sizeMin, spec.sizeMax)(generator);
+
+    if (spec.sizeKind == EXPONENTIAL_SIZE)
+        return min(size_t(exponential_distribution<double>(1.0 / spec.sizeMin)(generator)) + 1, spec.sizeMax);
+
+    return spec.sizeMin;
+}
+
+template <class Send>
+inline void TrafficGenerator::run(uint64_t now, Send send)
+{
+    if (!started)
+    {
+        origin = now;
+        started = true;
+    }
+
+    uint64_t elapsed = now - origin;
+    size_t burst = 0;
+
+    // Every flow gets its turn first in a run, so one far behind cannot keep the others out
+    size_t first = nextFlow;
+    for (size_t k = 0; k < flows.size(); k++)
+    {
+        size_t i = (first + k) % flows.size();
+        FlowSent &flow = flows[i];
+        uint64_t gap = max(uint64_t(TRAFFIC_SECOND / flow.spec.rate), uint64_t(1));
+
+        // Everything due, but a flow that fell far behind does not starve the event loop
+        while (flow.due <= elapsed && flow.due < flow.spec.stop && burst < TRAFFIC_BURST)
+        {
+            makePayload(flow.flow, flow.packets + flow.noRoute, now, drawSize(flow.spec), payload);
+
+            if (send(flow.flow, flow.spec.dest, payload))
+            {
+                flow.packets++;
+                flow.bytes += payload.length();
+            }
+            else
+            {
+                flow.noRoute++;
+            }
+
+            flow.due += gap;
+            burst++;
+        }
+
+        // The burst ran out here, so the next run starts with the flows that got nothing
+        if (burst == TRAFFIC_BURST)
+        {
+            nextFlow = (i + 1) % flows.size();
+            return;
+        }
+    }
+}
+
+class TrafficSink
+{
+public:
+    // Flows seen by the destination, by flow number
+    map<size_t, FlowReceived> flows;
+
+    // Count a generated packet that arrived at now
+    void receive(size_t src, size_t flow, uint64_t seq, uint64_t sent, uint64_t now, size_t bytes);
+};
+
+inline void TrafficSink::receive(size_t src, size_t flow, uint64_t seq, uint64_t sent, uint64_t now, size_t bytes)
+{
+    FlowReceived &seen = flows[flow];
+    if (seen.packets == 0)
+    {
+        seen.src = src;
+        seen.first = now;
+    }
+
+    seen.packets++;
+    seen.bytes += bytes;
+    seen.expected = max(seen.expected, seq + 1);
+    seen.last = now;
+
+    // Clocks of the processes are the same monotonic clock, a packet cannot arrive before it left
+    uint64_t latency = now > sent ? now - sent : 0;
+    seen.latencySum += latency;
+    seen.latencyMax = max(seen.latencyMax, latency);
+}
+
+// Write what the node sent and received, one line per flow
+inline void writeFlowReport(const string &fileName, const TrafficGenerator &sent, const TrafficSink &received)
+{
+    ofstream file(fileName.c_str(), ios::out | ios::trunc);
+
+    for (size_t i = 0; i < sent.flows.size(); i++)
+    {
+        const FlowSent &flow = sent.flows[i];
+        file << "sent flow " << flow.flow << " to " << flow.spec.dest
+             << " packets " << flow.packets << " bytes " << flow.bytes << " no_route " << flow.noRoute << "\n";
+    }
+
+    for (map<size_t, FlowReceived>::const_iterator it = received.flows.begin(); it != received.flows.end(); ++it)
+    {
+        const FlowReceived &flow = it->second;
+        file << "received flow " << it->first << " from " << flow.src
+             << " packets " << flow.packets << " lost " << flow.lost() << " bytes " << flow.bytes
+             << " goodput_bps " << uint64_t(flow.goodput())
+             << " latency_avg_ms " << double(flow.latencySum) / flow.packets / 1000
+             << " latency_max_ms " << double(flow.latencyMax) / 1000 << "\n";
+    }
+}
+
+#endif
@@ -0,0 +1,212 @@
+/*
+ *  Hierarchical timing wheel, which holds a huge number of timers and
+ *  schedules and expires each of them in constant time.
+ *  Copyright (C) 2021 Sourabh J Choure
+ *
+ *  I promise that the work presented below is of my own.
+ *
+ *  To make it FOSS Compliant, this software is free to use.
+ */
+
+#ifndef WHEEL_H
+#define WHEEL_H
+
+// STL
+#include <vector>
+// SL
+#include <stdint.h>
+
+using namespace std;
+
+// Slots of a level, and the bits of the tick every level stands for
+#define WHEEL_SLOTS 256
+#define WHEEL_BITS 8
+
+// Levels of the wheel, a timer further than 2^32 ticks ahead goes around the top level again
+#define WHEEL_LEVELS 4
+
+// End of a list of timers
+#define WHEEL_NONE 0xffffffffu
+
+// Timers named by small integers, each due at a time in microseconds
+// A timer sits in the level of the highest byte where its tick differs from the current one, the top level at most,
+// so a slot of a higher level moves down the moment the current tick enters it,
+// and timers due in the same tick expire in the order they were scheduled
+class TimingWheel
+{
+public:
+    TimingWheel(uint64_t tickUs) : tickUs(tickUs), head(WHEEL_LEVELS * WHEEL_SLOTS, WHEEL_NONE), tail(WHEEL_LEVELS * WHEEL_SLOTS, WHEEL_NONE){};
+
+    // Hold the timer id until due, never less than a tick after now
+    void schedule(uint32_t id, uint64_t due, uint64_t now);
+
+    // Expire every timer due by now, in order, with expire(id)
+    template <class Expire>
+    void advance(uint64_t now, Expire expire);
+
+    // Earliest time a timer may be due, false if there is none
+    bool nextDue(uint64_t &) const;
+
+    // Timers held
+    size_t size() const { return count; };
+
+private:
+    // Microseconds in a tick
+    uint64_t tickUs;
+
+    // Time of tick 0, the first tick of the first timer, so the ticks stay far from wrapping around
+    uint64_t origin = 0;
+    bool started = false;
+
+    // Last tick that expired
+    uint64_t current = 0;
+
+    // Timers held
+    size_t count = 0;
+
+    // First and last timer of every slot, level by level
+    vector<uint32_t> head;
+    vector<uint32_t> tail;
+
+    // Next timer in the same slot, and the tick every timer is due, never moved
+    vector<uint32_t> next;
+    vector<uint64_t> tick;
+
+    // Put the timer at the end of the slot its tick belongs to
+    void place(uint32_t);
+
+    // Move the timers of a slot of a higher level down
+    void cascade(size_t);
+};
+
+inline void TimingWheel::place(uint32_t id)
+{
+    // Level of the highest byte that differs, a timer beyond the top level waits in it and is placed again when its slot moves down
+    uint64_t diff = tick[id] ^ current;
+    size_t level = diff ? min((size_t)(63 - __builtin_clzll(diff)) / WHEEL_BITS, (size_t)WHEEL_LEVELS - 1) : 0;
+
+    size_t slot = level * WHEEL_SLOTS + ((tick[id] >> (level * WHEEL_BITS)) & (WHEEL_SLOTS - 1));
+
+    // Append, so the slot keeps the order the timers came in
+    next[id] = WHEEL_NONE;
+    if (tail[slot] == WHEEL_NONE)
+        head[slot] = id;
+    else
+        next[tail[slot]] = id;
+    tail[slot] = id;
+}
+
+inline void TimingWheel::schedule(uint32_t id, uint64_t due, uint64_t now)
+{
+    if (id >= next.size())
+    {
+        next.resize(id + 1, WHEEL_NONE);
+        tick.resize(id + 1, 0);
+    }
+
+    // Ticks count from a tick boundary at or before the first timer
+    if (!started)
+    {
+        origin = now - now % tickUs;
+        started = true;
+    }
+
+    // An empty wheel skips the ticks nobody waited for
+    uint64_t nowTick = (now - origin) / tickUs;
+    if (count == 0 && current < nowTick)
+        current = nowTick;
+
+    // Never early, and never in a tick that already expired
+    tick[id] = max((max(due, origin) - origin + tickUs - 1) / tickUs, current + 1);
+    place(id);
+    count++;
+}
+
+inline void TimingWheel::cascade(size_t level)
+{
+    size_t slot = level * WHEEL_SLOTS + ((current >> (level * WHEEL_BITS)) & (WHEEL_SLOTS - 1));
+    uint32_t id = head[slot];
+    head[slot] = tail[slot] = WHEEL_NONE;
+
+    // Every timer lands in a lower level now that the upper bytes match
+    while (id != WHEEL_NONE)
+    {
+        uint32_t following = next[id];
+        place(id);
+        id = following;
+    }
+}
+
+template <class Expire>
+inline void TimingWheel::advance(uint64_t now, Expire expire)
+{
+    if (!started)
+        return;
+
+    uint64_t nowTick = (now - origin) / tickUs;
+
+    while (current < nowTick)
+    {
+        // Nothing left to wait for
+        if (count == 0)
+        {
+            current = nowTick;
+            return;
+        }
+
+        current++;
+
+        // Entering a new slot of a level moves it down, the highest level first
+        size_t wrapped = 0;
+        while (wrapped + 1 < WHEEL_LEVELS && ((current >> ((wrapped + 1) * WHEEL_BITS)) << ((wrapped + 1) * WHEEL_BITS)) == current)
+            wrapped++;
+        for (size_t level = wrapped; level > 0; level--)
+            cascade(level);
+
+        // Every timer of the lowest slot is due now
+        size_t slot = current & (WHEEL_SLOTS - 1);
+        uint32_t id = head[slot];
+        head[slot] = tail[slot] = WHEEL_NONE;
+        while (id != WHEEL_NONE)
+        {
+            uint32_t following = next[id];
+            count--;
+            expire(id);
+            id = following;
+        }
+    }
+}
+
+inline bool TimingWheel::nextDue(uint64_t &at) const
+{
+    if (count == 0)
+        return false;
+
+    // The first slot ahead that holds anything, the lowest level first
+    for (size_t level = 0; level < WHEEL_LEVELS; level++)
+    {
+        size_t shift = level * WHEEL_BITS;
+        uint64_t position = (current >> shift) & (WHEEL_SLOTS - 1);
+        uint64_t block = (current >> (shift + WHEEL_BITS)) << (shift + WHEEL_BITS);
+
+        // Only the top level holds timers in the slots behind, and in the current one, for its next turn
+        uint64_t last = (level == WHEEL_LEVELS - 1) ? position + WHEEL_SLOTS : WHEEL_SLOTS - 1;
+
+        for (uint64_t k = position + 1; k <= last; k++)
+        {
+            uint64_t s = k & (WHEEL_SLOTS - 1);
+            if (head[level * WHEEL_SLOTS + s] == WHEEL_NONE)
+                continue;
+
+            // Start of that slot, where its timers move down or expire
+            at = origin + (block + (k << shift)) * tickUs;
+            return true;
+        }
+    }
+
+    // Every timer is in a slot ahead, so this is never reached
+    at = origin + (current + 1) * tickUs;
+    return true;
+}
+
+#endif
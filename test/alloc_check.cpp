@@ -0,0 +1,146 @@
+/*
+ *  Checks that a warmed up node reads, parses and forwards messages
+ *  without a single heap allocation, by counting every operator new.
+ *  Copyright (C) 2021 Sourabh J Choure
+ *
+ *  I promise that the work presented below is of my own.
+ *
+ *  To make it FOSS Compliant, this software is free to use.
+ */
+
+// STL
+#include <iostream>
+#include <new>
+// SL
+#include <cstdlib>
+#include <cstring>
+// Node
+#include "../src/node.h"
+
+using namespace std;
+
+// Events handed to the node before counting, and while counting
+#define WARMUP_ROUNDS 200
+#define COUNTED_ROUNDS 200
+
+// Allocations made while counting
+static size_t allocations = 0;
+static bool counting = false;
+
+void *operator new(size_t size)
+{
+    if (counting)
+        allocations++;
+
+    void *p = malloc(size ? size : 1);
+    if (p == NULL)
+        throw bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+int main(int argc, char *argv[])
+{
+    // Usage: alloc_check.out [text|binary] [file|segment] [full|incremental|weighted]
+    NodeOptions options;
+    options.numNodes = 10;
+
+    bool valid = true;
+    if (argc > 1)
+        valid = parseWire(argv[1], options.wire);
+    if (argc > 2 && valid)
+        valid = parseBackend(argv[2], options.backend) && options.backend != SHM_BACKEND;
+    if (argc > 3 && valid)
+    {
+        if (strcmp(argv[3], "full") == 0)
+            options.spt = FULL_SPT;
+        else if (strcmp(argv[3], "incremental") == 0)
+            options.spt = INCREMENTAL_SPT;
+        else if (strcmp(argv[3], "weighted") == 0)
+            options.spt = WEIGHTED_SPT;
+        else
+            valid = false;
+    }
+    if (!valid || argc > 4)
+    {
+        cout << "Usage: alloc_check.out [text|binary] [file|segment] [full|incremental|weighted]" << endl;
+        return 2;
+    }
+
+    // Node 1 hears from node 0, which reaches 3 and 4 through its own tree
+    Node node(1, 100, -1, "", options);
+
+    // Plays the controller, writing into the input of the node
+    FileDescriptor feed;
+    feed.backend = options.backend;
+    feed.wire = options.wire;
+    feed.flushMs = 0;
+    feed.outputFileName = "input_1";
+    feed.openOutput(false);
+
+    string message;
+    vector<pair<size_t, size_t>> edges;
+    edges.push_back(make_pair(1, 0));
+    edges.push_back(make_pair(3, 0));
+    edges.push_back(make_pair(4, 3));
+
+    encodeHello(options.wire, 0, message);
+    feed.writeMessage(message);
+    encodeIntree(options.wire, 0, edges, message);
+    feed.writeMessage(message);
+    feed.flush();
+
+    node.handleEvent(Node::INPUT_EVENT);
+    node.handleEvent(Node::CHECK_EVENT);
+
+    // Data that goes on to 2, that is for the node, and that has no route
+    size_t onward[] = {1, 2};
+    size_t here[] = {1};
+
+    for (size_t round = 0; round < WARMUP_ROUNDS + COUNTED_ROUNDS; round++)
+    {
+        encodeHello(options.wire, 0, message);
+        feed.writeMessage(message);
+
+        // The tree of node 0 loses and gets back a branch, so the intree changes
+        if (round % 10 == 0)
+        {
+            edges.resize(2);
+            if (round % 20)
+                edges.push_back(make_pair(4, 3));
+            encodeIntree(options.wire, 0, edges, message);
+            feed.writeMessage(message);
+        }
+
+        for (size_t k = 0; k < 5; k++)
+        {
+            encodeData(options.wire, 5, 2, onward, 2, "hello there", 11, message);
+            feed.writeMessage(message);
+            encodeData(options.wire, 5, 1, here, 1, "for me", 6, message);
+            feed.writeMessage(message);
+            encodeData(options.wire, 5, 4, here, 1, "via 0", 5, message);
+            feed.writeMessage(message);
+        }
+        feed.flush();
+
+        // Only the node is counted, not the feed
+        counting = round >= WARMUP_ROUNDS;
+        node.handleEvent(round % 10 == 5 ? Node::INTREE_EVENT : Node::INPUT_EVENT);
+        counting = false;
+    }
+
+    cout << "alloc-check " << (argc > 1 ? argv[1] : "text") << " " << (argc > 2 ? argv[2] : "file") << " " << (argc > 3 ? argv[3] : "full")
+         << ": " << allocations << " allocations in " << COUNTED_ROUNDS << " events, " << node.stats.dataForwarded << " forwarded, "
+         << node.stats.dataReceived << " received" << endl;
+
+    return allocations ? 1 : 0;
+}
@@ -0,0 +1,242 @@
+/*
+ *  Checks the timing wheel against a plain reference model, with timers
+ *  scheduled and expired at random over every level of the wheel.
+ *  Copyright (C) 2021 Sourabh J Choure
+ *
+ *  I promise that the work presented below is of my own.
+ *
+ *  To make it FOSS Compliant, this software is free to use.
+ */
+
+// STL
+#include <iostream>
+#include <random>
+#include <set>
+#include <vector>
+// SL
+#include <cstdlib>
+#include <stdint.h>
+// Wheel
+#include "../src/wheel.h"
+
+using namespace std;
+
+// Rounds of scheduling and advancing, and the most timers scheduled in one
+#define CHECK_STEPS 20000
+#define CHECK_BURST 20
+
+// Timers of the reference model, in the order they must expire
+struct Expected
+{
+    // Tick it is due, and its place among the timers scheduled so far
+    uint64_t tick;
+    uint64_t seq;
+
+    uint32_t id;
+
+    bool operator<(const Expected &other) const
+    {
+        return tick != other.tick ? tick < other.tick : seq < other.seq;
+    }
+};
+
+// Reference model, every timer sorted by its tick and then by when it was scheduled
+// Ticks are whole multiples of the tick length, the wheel counts them from one of them too
+class Reference
+{
+public:
+    Reference(uint64_t tickUs) : tickUs(tickUs){};
+
+    // Due in the first tick at or after due, never in one that already expired
+    void schedule(uint32_t id, uint64_t due, uint64_t now)
+    {
+        if (pending.empty())
+            current = max(current, now / tickUs);
+
+        Expected timer = {max((due + tickUs - 1) / tickUs, current + 1), seq++, id};
+        pending.insert(timer);
+
+        // The later of when it was asked for and when it was scheduled
+        deadline[id] = max(due, now);
+        deadlines.insert(deadline[id]);
+    }
+
+    // Every timer due by now, in order
+    void advance(uint64_t now, vector<uint32_t> &expired)
+    {
+        current = max(current, now / tickUs);
+
+        while (!pending.empty() && pending.begin()->tick <= current)
+        {
+            expired.push_back(pending.begin()->id);
+            deadlines.erase(deadlines.find(deadline[pending.begin()->id]));
+            pending.erase(pending.begin());
+        }
+    }
+
+    // Microseconds in a tick
+    uint64_t tickUs;
+
+    // Last tick that expired
+    uint64_t current = 0;
+
+    // Timers held, and when each was due
+    set<Expected> pending;
+    vector<uint64_t> deadline = vector<uint64_t>(CHECK_STEPS * CHECK_BURST);
+    multiset<uint64_t> deadlines;
+
+private:
+    // Timers scheduled so far
+    uint64_t seq = 0;
+};
+
+// Compare the size and the next due time of the wheel with the model
+static bool sameView(const TimingWheel &wheel, const Reference &reference)
+{
+    if (wheel.size() != reference.pending.size())
+    {
+        cout << "wheel-check: holds " << wheel.size() << " timers, expected " << reference.pending.size() << endl;
+        return false;
+    }
+
+    // Some time in the tick after the last one that expired, and no later than the earliest timer
+    uint64_t at;
+    bool due = wheel.nextDue(at);
+    if (due != !reference.pending.empty())
+    {
+        cout << "wheel-check: next due " << (due ? "given" : "missing") << " with " << reference.pending.size() << " timers" << endl;
+        return false;
+    }
+    if (due && (at < (reference.current + 1) * reference.tickUs || at > reference.pending.begin()->tick * reference.tickUs))
+    {
+        cout << "wheel-check: next due at " << at << ", expected between " << (reference.current + 1) * reference.tickUs << " and "
+             << reference.pending.begin()->tick * reference.tickUs << endl;
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    // Usage: wheel_check.out [tick-us] [seed]
+    uint64_t tickUs = argc > 1 ? strtoull(argv[1], NULL, 10) : 100;
+    uint64_t seed = argc > 2 ? strtoull(argv[2], NULL, 10) : 1;
+    if (tickUs == 0 || argc > 3)
+    {
+        cout << "Usage: wheel_check.out [tick-us] [seed]" << endl;
+        return 2;
+    }
+
+    mt19937_64 random(seed);
+    TimingWheel wheel(tickUs);
+    Reference reference(tickUs);
+
+    // Start anywhere, away from a tick boundary
+    uint64_t now = random() % 1000000000000ULL;
+
+    vector<uint32_t> freeIds;
+    uint32_t nextId = 0;
+    vector<uint32_t> expired, expected;
+    size_t scheduled = 0;
+
+    for (size_t step = 0; step < CHECK_STEPS; step++)
+    {
+        // Mostly near timers, some in the middle levels and a few in the top level
+        size_t burst = random() % (CHECK_BURST + 1);
+        for (size_t k = 0; k < burst; k++)
+        {
+            uint64_t kind = random() % 10;
+            uint64_t ticks = kind < 6 ? random() % 300 : kind < 9 ? random() % 70000 : random() % (1ULL << 25);
+
+            // Now and then due already, or right on a tick boundary
+            uint64_t due = now + ticks * tickUs + random() % tickUs;
+            if (kind == 0)
+                due = now - min(now, (uint64_t)(random() % (3 * tickUs)));
+            else if (kind == 1)
+                due -= due % tickUs;
+
+            // Reuse the ids of expired timers, as the link emulator does
+            uint32_t id = nextId;
+            if (!freeIds.empty() && random() % 2)
+            {
+                id = freeIds.back();
+                freeIds.pop_back();
+            }
+            else
+            {
+                nextId++;
+            }
+
+            wheel.schedule(id, due, now);
+            reference.schedule(id, due, now);
+            scheduled++;
+        }
+
+        if (!sameView(wheel, reference))
+            return 1;
+
+        // Step a little, to the next due time, or far past it
+        uint64_t at;
+        uint64_t kind = random() % 10;
+        if (kind < 3 && wheel.nextDue(at))
+            now = max(now, at);
+        else if (kind < 4)
+            now += random() % (1000 * tickUs);
+        else
+            now += random() % (3 * tickUs);
+
+        expired.clear();
+        expected.clear();
+        wheel.advance(now, [&](uint32_t id) { expired.push_back(id); });
+        reference.advance(now, expected);
+
+        // Never before it was due
+        for (size_t i = 0; i < expired.size(); i++)
+        {
+            if (reference.deadline[expired[i]] > now)
+            {
+                cout << "wheel-check: timer " << expired[i] << " due at " << reference.deadline[expired[i]] << " expired early at " << now << endl;
+                return 1;
+            }
+        }
+
+        // The same timers as the model, those of a tick in the order they were scheduled
+        if (expired != expected)
+        {
+            cout << "wheel-check: expired " << expired.size() << " timers at " << now << ", expected " << expected.size() << " in another order" << endl;
+            return 1;
+        }
+
+        // Nothing still held more than a tick after it was due
+        if (!reference.deadlines.empty() && *reference.deadlines.begin() + tickUs <= now)
+        {
+            cout << "wheel-check: a timer due at " << *reference.deadlines.begin() << " is still held at " << now << endl;
+            return 1;
+        }
+
+        if (!sameView(wheel, reference))
+            return 1;
+
+        freeIds.insert(freeIds.end(), expired.begin(), expired.end());
+    }
+
+    // Everything left expires once its tick has passed
+    if (!reference.pending.empty())
+    {
+        now = reference.pending.rbegin()->tick * tickUs;
+        expired.clear();
+        expected.clear();
+        wheel.advance(now, [&](uint32_t id) { expired.push_back(id); });
+        reference.advance(now, expected);
+        if (expired != expected || wheel.size() != 0)
+        {
+            cout << "wheel-check: " << wheel.size() << " timers left after the last tick" << endl;
+            return 1;
+        }
+    }
+
+    cout << "wheel-check tick " << tickUs << " seed " << seed << ": " << scheduled << " timers expired in order" << endl;
+
+    return 0;
+}